@@ -0,0 +1,205 @@
+#!/bin/sh
+#
+# bytecopy benchmark
+# GPL-3.0 License
+#
+# Copies test files with every combination of input, buffer size and option
+# set, appends the --stats-json report of each run to a results file and
+# prints the medians, side by side if two builds are given.
+#
+
+BUFFERS="64K 512K 4M"
+DIRS=""
+INPUTS="cached uncached sparse pipe"
+OPTIONS="--engine rw;--engine zero;--engine thread;--engine uring;-j 4;-B;-S;-y;--write-behind 8M;--direct rw"
+RUNS=3
+RESULTS=bench-results.jsonl
+SIZE=128M
+COMPARE=0
+
+usage() {
+    cat >&2 <<EOF
+Usage: bench.sh [OPTION]... BYTECOPY [BYTECOPY2]
+       bench.sh -c RESULTS RESULTS2
+Benchmark BYTECOPY, or compare it with BYTECOPY2 (the runs alternate),
+and append one JSON object per run to the results file.
+With -c, summarize and compare two results files instead.
+
+    -b LIST     buffer sizes (default: $BUFFERS)
+    -c          compare results files
+    -d DIR      create test files in DIR, may be repeated to compare
+                file systems (default: \$TMPDIR or /tmp)
+    -h          print this help and exit
+    -i LIST     inputs out of: cached, uncached, sparse, pipe (default: all)
+    -n N        runs per case, the median is reported (default: $RUNS)
+    -o FILE     append results to FILE (default: $RESULTS)
+    -s SIZE     size of the test files (default: $SIZE)
+    -x LIST     option sets separated by ';' (default: $OPTIONS)
+EOF
+}
+
+# SIZE with suffix in bytes
+bytes() {
+    case $1 in
+        *K) echo $((${1%K} * 1024)) ;;
+        *M) echo $((${1%M} * 1024 * 1024)) ;;
+        *G) echo $((${1%G} * 1024 * 1024 * 1024)) ;;
+        *) echo $(($1)) ;;
+    esac
+}
+
+# test files, reused while their size matches
+prepare() {
+    dir=$1/bytecopy-bench
+    mkdir -p "$dir" || exit 1
+    if [ ! -f "$dir/dense" ] || [ "$(wc -c < "$dir/dense")" != "$LEN" ]; then
+        echo "creating $dir/dense" >&2
+        "$BIN" -Q -i /dev/urandom -to "$dir/dense" +"$LEN" || exit 1
+    fi
+    if [ ! -f "$dir/sparse" ] || [ "$(wc -c < "$dir/sparse")" != "$LEN" ]; then
+        # 1M of data every 16M, holes between
+        echo "creating $dir/sparse" >&2
+        "$BIN" -Q -i /dev/null -to "$dir/sparse" -T "$LEN" || exit 1
+        off=0
+        while [ $off -lt "$LEN" ]; do
+            "$BIN" -Q -i "$dir/dense" -o "$dir/sparse" -w $off $off +1M -E || exit 1
+            off=$((off + 16777216))
+        done
+    fi
+}
+
+# one copy, the report goes to the results file
+run() {
+    build=$1 bin=$2 dir=$3 input=$4 buffer=$5 opts=$6 n=$7
+    src=$dir/bytecopy-bench/dense
+    case $input in
+        cached) cat "$src" > /dev/null ;;
+        uncached) dd if="$src" iflag=nocache count=0 2>/dev/null ;;
+        sparse) src=$dir/bytecopy-bench/sparse ;;
+    esac
+    rm -f "$dir/bytecopy-bench/stats"
+    if [ "$input" = pipe ]; then
+        # shellcheck disable=SC2086
+        cat "$src" | "$bin" -Q --stats-json "$dir/bytecopy-bench/stats" -b "$buffer" $opts -to "$dir/bytecopy-bench/out"
+    else
+        # shellcheck disable=SC2086
+        "$bin" -Q --stats-json "$dir/bytecopy-bench/stats" -b "$buffer" $opts -i "$src" -to "$dir/bytecopy-bench/out"
+    fi
+    status=$?
+    stats=$(tail -n 1 "$dir/bytecopy-bench/stats" 2>/dev/null)
+    [ -n "$stats" ] || stats=null
+    printf '{"build":"%s","binary":"%s","dir":"%s","input":"%s","buffer":"%s","options":"%s","size":%s,"run":%s,"status":%s,"stats":%s}\n' \
+        "$build" "$bin" "$dir" "$input" "$buffer" "$opts" "$LEN" "$n" "$status" "$stats" >> "$RESULTS"
+    printf '.' >&2
+}
+
+# medians per case and build, the second build relative to the first
+summary() {
+    awk '
+    function num(key,   v) {
+        if (!match($0, "\"" key "\":[0-9.]+")) return -1
+        v = substr($0, RSTART, RLENGTH)
+        return substr(v, index(v, ":") + 1) + 0
+    }
+    function str(key,   v) {
+        if (!match($0, "\"" key "\":\"[^\"]*\"")) return ""
+        v = substr($0, RSTART, RLENGTH)
+        return substr(v, length(key) + 5, length(v) - length(key) - 5)
+    }
+    function median(list,   v, n, i, j, t) {
+        n = split(list, v, " ")
+        for (i = 2; i <= n; i++) for (j = i; j > 1 && v[j - 1] + 0 > v[j] + 0; j--) { t = v[j]; v[j] = v[j - 1]; v[j - 1] = t }
+        return n % 2 ? v[(n + 1) / 2] : (v[n / 2] + v[n / 2 + 1]) / 2
+    }
+    {
+        b = str("build")
+        if (FILENAME != first && first != "" && files) b = "b"
+        else if (files) b = "a"
+        if (first == "") first = FILENAME
+        c = str("dir") " " str("input") " -b " str("buffer") " " str("options")
+        if (!(c in seen)) { seen[c] = 1; cases[++ncases] = c }
+        builds[b] = 1
+        if (num("status") != 0 || num("bytes_out") <= 0) next
+        gb = num("bytes_out") / 1073741824
+        calls = num("reads") + num("writes") + (match($0, "\"sync\":\\{\"count\":[0-9]+") ? substr($0, RSTART + 16, RLENGTH - 16) : 0)
+        rate[c, b] = rate[c, b] " " num("rate_avg") / 1e6
+        perGb[c, b] = perGb[c, b] " " calls / gb
+        cpu[c, b] = cpu[c, b] " " (num("cpu_user") + num("cpu_sys")) / gb
+        rss[c, b] = rss[c, b] " " num("max_rss_kb") / 1024
+    }
+    END {
+        two = ("a" in builds) && ("b" in builds)
+        if (two) printf "%-56s %10s %10s %8s %10s %10s %8s %8s\n", "case", "MB/s a", "MB/s b", "change", "calls/GB a", "calls/GB b", "CPU s/GB", "RSS MB"
+        else printf "%-56s %10s %10s %8s %8s\n", "case", "MB/s", "calls/GB", "CPU s/GB", "RSS MB"
+        for (i = 1; i <= ncases; i++) {
+            c = cases[i]
+            if (two) {
+                if (rate[c, "a"] == "" || rate[c, "b"] == "") { printf "%-56s %10s\n", c, "no result"; continue }
+                ra = median(rate[c, "a"]); rb = median(rate[c, "b"])
+                printf "%-56s %10.1f %10.1f %+7.1f%% %10.0f %10.0f %8.3f %8.1f\n", c, ra, rb, (ra > 0 ? (rb - ra) / ra * 100 : 0), median(perGb[c, "a"]), median(perGb[c, "b"]), median(cpu[c, "b"]), median(rss[c, "b"])
+            } else {
+                for (b in builds) break
+                if (rate[c, b] == "") { printf "%-56s %10s\n", c, "no result"; continue }
+                printf "%-56s %10.1f %10.0f %8.3f %8.1f\n", c, median(rate[c, b]), median(perGb[c, b]), median(cpu[c, b]), median(rss[c, b])
+            }
+        }
+    }' files="$1" "$2" ${3:+"$3"}
+}
+
+while getopts ":b:cd:hi:n:o:s:x:" opt; do
+    case $opt in
+        b) BUFFERS=$OPTARG ;;
+        c) COMPARE=1 ;;
+        d) DIRS="$DIRS$OPTARG
+" ;;
+        h) usage; exit 0 ;;
+        i) INPUTS=$OPTARG ;;
+        n) RUNS=$OPTARG ;;
+        o) RESULTS=$OPTARG ;;
+        s) SIZE=$OPTARG ;;
+        x) OPTIONS=$OPTARG ;;
+        *) usage; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ $COMPARE -eq 1 ]; then
+    [ $# -eq 2 ] || { usage; exit 1; }
+    summary 1 "$1" "$2"
+    exit
+fi
+[ $# -eq 1 ] || [ $# -eq 2 ] || { usage; exit 1; }
+BIN=$1
+BIN2=$2
+LEN=$(bytes "$SIZE")
+[ -n "$DIRS" ] || DIRS=${TMPDIR:-/tmp}
+: > "$RESULTS" || exit 1
+
+IFS_DEFAULT=$IFS
+IFS='
+'
+for dir in $DIRS; do
+    prepare "$dir"
+done
+for dir in $DIRS; do
+    for input in $(echo "$INPUTS" | tr ' ' '\n'); do
+        for buffer in $(echo "$BUFFERS" | tr ' ' '\n'); do
+            for opts in $(echo "$OPTIONS" | tr ';' '\n'); do
+                n=1
+                while [ $n -le "$RUNS" ]; do
+                    IFS=$IFS_DEFAULT
+                    run a "$BIN" "$dir" "$input" "$buffer" "$opts" $n
+                    [ -z "$BIN2" ] || run b "$BIN2" "$dir" "$input" "$buffer" "$opts" $n
+                    IFS='
+'
+                    n=$((n + 1))
+                done
+            done
+        done
+    done
+    rm -rf "$dir/bytecopy-bench"
+done
+IFS=$IFS_DEFAULT
+echo >&2
+
+summary 0 "$RESULTS"
@@ -6,6 +6,7 @@
  * 
  */
 
+#define _GNU_SOURCE
 #define _LARGEFILE64_SOURCE
 
 #include <stdio.h>
@@ -17,14 +18,221 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <string.h>
+#include <ctype.h>
 #include <endian.h>
 #include <errno.h>
 #include <getopt.h>
 #include <locale.h>
+#include <limits.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#include <linux/io_uring.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
 
 #define BUFFER_DEFAULT 1024 * 512
 #define FD_IDX_DEFAULT 3
 
+#define ENGINE_RW 0
+#define ENGINE_ZERO 1
+#define ENGINE_THREAD 2
+#define ENGINE_URING 3
+#define ENGINE_PARALLEL 4
+
+#define SLOT_FREE 0
+#define SLOT_READING 1
+#define SLOT_READ 2
+#define SLOT_WRITING 3
+#define SLOT_SYNCING 4
+
+#define DIRECT_IN 1
+#define DIRECT_OUT 2
+
+#define OPT_ENGINE 256
+#define OPT_DIRECT 257
+#define OPT_BUFFERS 258
+#define OPT_DEPTH 259
+#define OPT_SPLIT 260
+#define OPT_SPARSE 261
+#define OPT_REFLINK 262
+#define OPT_STATS_JSON 263
+#define OPT_STATS_INTERVAL 264
+#define OPT_LIMIT 265
+#define OPT_LIMIT_OPS 266
+#define OPT_LIMIT_FILE 267
+#define OPT_WRITE_BEHIND 268
+#define OPT_HASH 269
+#define OPT_HASH_IN 270
+#define OPT_EXPECT 271
+#define OPT_DELTA 272
+#define OPT_INDEX_DELIM 273
+#define OPT_INDEX_SIZE 274
+#define OPT_INDEX_HEADER 275
+#define OPT_GATHER 276
+#define OPT_BATCH 277
+#define OPT_JOURNAL 278
+#define OPT_JOURNAL_INTERVAL 279
+#define OPT_RESUME 280
+#define OPT_RESCUE 281
+#define OPT_REVERSE 282
+#define OPT_FILL 283
+#define OPT_COALESCE 284
+
+#define CLONE_CHUNK (1024 * 1024 * 1024)
+#define GATHER_GAP (32 * 1024)
+#define AUTO_MAX (16 * 1024 * 1024)
+#define JOURNAL_INTERVAL (256 * 1024 * 1024)
+#define JOURNAL_CHECK (64 * 1024)
+#define TEE_BUFFERS 8
+#define RESCUE_SAVE (30 * 1000000000ULL)
+#define FILL_CHUNK (1024 * 1024 * 1024)
+#define FILL_IOV 16
+#define FILL_MAX 256
+#define COALESCE_MS 100
+
+#define FILL_ZERO 1
+#define FILL_DISCARD 2
+#define FILL_PATTERN 3
+
+#define INDEX_DELIM 1
+#define INDEX_SIZE 2
+#define INDEX_HEADER 3
+#define INDEX_DELIM_MAX 64
+#define INDEX_BATCH 4096
+
+#define HASH_CRC32C 1
+#define HASH_XXH3 2
+#define HASH_SHA256 3
+
+#define XXH3_STRIPE 64
+#define XXH3_BLOCK 16
+#define XXH3_BUFFER 256
+#define XXH3_SECRET 192
+
+#define XXH_PRIME32_1 0x9e3779b1U
+#define XXH_PRIME32_2 0x85ebca77U
+#define XXH_PRIME32_3 0xc2b2ae3dU
+#define XXH_PRIME64_1 0x9e3779b185ebca87ULL
+#define XXH_PRIME64_2 0xc2b2ae3d27d4eb4fULL
+#define XXH_PRIME64_3 0x165667b19e3779f9ULL
+#define XXH_PRIME64_4 0x85ebca77c2b2ae63ULL
+#define XXH_PRIME64_5 0x27d4eb2f165667c5ULL
+#define XXH_PRIME_MX1 0x165667919e3779f9ULL
+#define XXH_PRIME_MX2 0x9fb21c651e98df25ULL
+
+#define LAT_READ 0
+#define LAT_WRITE 1
+#define LAT_SYNC 2
+#define LAT_XFER 3
+#define LAT_KINDS 4
+#define LAT_BUCKETS 40
+
+struct latHist {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[LAT_BUCKETS];
+};
+
+struct hash {
+    char alg;
+    uint64_t len;
+    uint32_t crc;
+    uint32_t sha[8];
+    uint64_t acc[8];
+    size_t stripes;
+    int buffered;
+    uint8_t buffer[XXH3_BUFFER];
+};
+
+struct autoBuffer {
+    int min;
+    int max;
+    int dir;
+    off64_t anchor;
+    uint64_t t;
+    uint64_t bytes;
+    int cycles;
+    double rate;
+};
+
+struct writeBehind {
+    off64_t dist;
+    off64_t outFrom;
+    off64_t outDone;
+    off64_t inShift;
+    off64_t inDone;
+    off64_t inAhead;
+    bool bIn;
+};
+
+struct journal {
+    char *path;
+    char *tmp;
+    off64_t interval;
+    off64_t next;
+    off64_t start;
+    off64_t end;
+    off64_t inFrom;
+    off64_t outFrom;
+    uint64_t in;
+    uint64_t out;
+    uint64_t rd;
+    uint64_t wr;
+    uint8_t *check;
+    int count;
+};
+
+struct indexGen {
+    char mode;
+    int delimLen;
+    uint8_t delim[INDEX_DELIM_MAX];
+    int64_t size;
+    int64_t adjust;
+    off64_t pos;
+    off64_t next;
+    off64_t pending;
+    int carryLen;
+    uint8_t carry[INDEX_DELIM_MAX];
+    int fill;
+    uint64_t count;
+    uint64_t entries[INDEX_BATCH];
+};
+
+struct gatherRange {
+    off64_t start;
+    off64_t end;
+    off64_t out;
+    int line;
+    bool failed;
+};
+
+struct throttle {
+    pthread_mutex_t lock;
+    int64_t rate;
+    int64_t ops;
+    double tokRate;
+    double tokOps;
+    uint64_t tFill;
+    char *path;
+    struct timespec mtime;
+    uint64_t tCheck;
+    bool bStatus;
+};
+
 struct ioStatus {
     uint64_t in;
     uint64_t out;
@@ -40,6 +248,144 @@ struct ioStatus {
     char endian;
     char prog;
     void *buffer;
+    uint64_t cloned;
+    uint64_t compared;
+    uint64_t skipped;
+    uint64_t tStart;
+    uint64_t tRate;
+    uint64_t outRate;
+    double rate;
+    FILE *stats;
+    uint64_t statsInt;
+    uint64_t statsNext;
+    struct latHist *lat;
+    struct throttle *limit;
+    const void *idxMap;
+    off64_t idxSize;
+};
+
+volatile sig_atomic_t limitReload = 0;
+
+struct copyJob {
+    off64_t pos;
+    off64_t offStart;
+    off64_t offEnd;
+    off64_t posOut;
+    off64_t sizeOut;
+    off64_t dataEnd;
+    int bufferLen;
+    int blockSize;
+    int align;
+    off64_t shiftIn;
+    int buffers;
+    int depth;
+    int threads;
+    int sparseBlock;
+    int deltaBlock;
+    void *deltaBuf;
+    int coalesce;
+    int coalesceMs;
+    char engine;
+    char direct;
+    char directSet;
+    bool bStatus;
+    bool bProgLF;
+    bool bFlushEach;
+    bool bWrEmpty;
+    bool bSync;
+    bool bSparse;
+    bool bReflink;
+    struct autoBuffer *autoBuf;
+    struct writeBehind *behind;
+    struct journal *journal;
+    struct hash *hashIn;
+    struct hash *hashOut;
+    struct indexGen *index;
+    int rd;
+    int wr;
+    int rq;
+};
+
+struct ringSlot {
+    void *buffer;
+    int len;
+    int reads;
+    int rd;
+    int err;
+    bool last;
+};
+
+struct ring {
+    struct ioStatus *io;
+    struct copyJob job;
+    struct ringSlot *slots;
+    sem_t free;
+    sem_t full;
+    bool stop;
+};
+
+struct uring {
+    int fd;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqRing;
+    void *cqRing;
+    size_t sqRingLen;
+    size_t cqRingLen;
+    size_t sqesLen;
+    unsigned tail;
+    unsigned pending;
+};
+
+struct uringSlot {
+    void *buffer;
+    off64_t pos;
+    uint64_t seq;
+    int rq;
+    int len;
+    int written;
+    int reads;
+    char state;
+};
+
+struct uringCopy {
+    struct ioStatus *io;
+    struct copyJob *job;
+    struct uringSlot *slots;
+    off64_t start;
+    off64_t inBase;
+    off64_t outBase;
+    bool fixed;
+};
+
+struct parallelCopy {
+    struct ioStatus *io;
+    struct copyJob *job;
+    off64_t start;
+    off64_t end;
+    off64_t inBase;
+    off64_t outBase;
+    off64_t eof;
+    off64_t fail;
+    uint64_t chunks;
+    uint64_t next;
+    uint64_t rd;
+    uint64_t wr;
+    uint64_t in;
+    uint64_t out;
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+    int err;
+    int failWr;
+    int failRq;
+    int active;
+    bool stop;
 };
 
 struct optRef {
@@ -47,6 +393,95 @@ struct optRef {
     char *str;
 };
 
+struct teeSlot {
+    void *buffer;
+    int len;
+    int pending;
+};
+
+struct teeOut {
+    char *path;
+    char *name;
+    int fd;
+    int flags;
+    struct optRef seek;
+    struct optRef truncate;
+    uint64_t out;
+    uint64_t wr;
+    uint64_t seq;
+    bool failed;
+    pthread_t thread;
+    struct tee *tee;
+};
+
+struct tee {
+    struct ioStatus *io;
+    struct copyJob *job;
+    struct teeSlot *slots;
+    struct teeOut *outs;
+    int nOuts;
+    int nSlots;
+    uint64_t filled;
+    bool done;
+    bool eof;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+struct rescueExtent {
+    off64_t start;
+    off64_t end;
+    char status;
+};
+
+struct rescueArea {
+    off64_t start;
+    off64_t end;
+    uint64_t first;
+};
+
+struct rescue {
+    struct ioStatus *io;
+    struct copyJob *job;
+    char *path;
+    char *tmp;
+    struct rescueExtent *map;
+    int n;
+    int cap;
+    struct rescueArea *todo;
+    int nTodo;
+    off64_t start;
+    off64_t end;
+    off64_t inBase;
+    off64_t outBase;
+    off64_t eof;
+    off64_t fail;
+    int sector;
+    void *zeros;
+    uint64_t chunks;
+    uint64_t next;
+    uint64_t tSave;
+    uint64_t rd;
+    uint64_t wr;
+    uint64_t in;
+    uint64_t out;
+    uint64_t bad;
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+    int err;
+    int active;
+    bool failWr;
+    bool bOutSet;
+    bool bReverse;
+    bool stop;
+};
+
+struct fill {
+    char mode;
+    int len;
+    uint8_t pattern[FILL_MAX];
+};
+
 void msg(char *fmt, ...) {
     va_list args;
     if (fmt[0] != '+') fprintf(stderr, "bytecopy: ");
@@ -82,8 +517,26 @@ char parseNum(char *str, int64_t *n) {
     return 0;
 }
 
+// map a regular index file, so entries are read without a system call each
+void mapIdx(struct ioStatus *io) {
+    struct stat st;
+    void *p;
+    if (fstat(io->fdIdx, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0) return;
+    if ((p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, io->fdIdx, 0)) == MAP_FAILED) return;
+    io->idxMap = p;
+    io->idxSize = st.st_size;
+}
+
 char readIdx(struct ioStatus *io, off64_t *offset, int64_t idx, int64_t *val) {
-    int n = (offset == NULL ? read(io->fdIdx, val, 8) : pread(io->fdIdx, val, 8, *offset + idx * 8));
+    off64_t at = offset == NULL ? 0 : *offset + idx * 8;
+    int n;
+    if (offset != NULL && io->idxMap != NULL && at >= 0 && at + 8 <= io->idxSize) {
+        memcpy(val, io->idxMap + at, 8);
+        n = 8;
+    } else {
+        // entries appended after mapping are still found
+        n = (offset == NULL ? read(io->fdIdx, val, 8) : pread(io->fdIdx, val, 8, at));
+    }
     if (n == 0) {
         if (*val == -1) return 0;
         msg("entry %" PRId64 " beyond end of index\n", idx);
@@ -104,6 +557,34 @@ char readIdx(struct ioStatus *io, off64_t *offset, int64_t idx, int64_t *val) {
     return 0;
 }
 
+// range ^n that contains input offset pos, by binary search over the index
+char findIdx(struct ioStatus *io, off64_t *offset, off64_t pos, int64_t *range) {
+    struct stat st;
+    int64_t lo = 0, hi, mid, val, loVal = INT64_MIN, hiVal = INT64_MAX;
+    if (fstat(io->fdIdx, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size < *offset) {
+        msg("looking up an offset needs the index to be a regular file\n");
+        return 1;
+    }
+    // entries before lo are not above pos, entries from hi on are, every probe has to lie between them
+    for (hi = (st.st_size - *offset) / 8; lo < hi;) {
+        mid = lo + (hi - lo) / 2;
+        if (readIdx(io, offset, mid, &val)) return 1;
+        if (val < loVal || val > hiVal) {
+            msg("index is not sorted, entry %" PRId64 " is out of order\n", mid);
+            return 1;
+        }
+        if (val <= pos) {
+            lo = mid + 1;
+            loVal = val;
+        } else {
+            hi = mid;
+            hiVal = val;
+        }
+    }
+    *range = lo;
+    return 0;
+}
+
 char readIdxStr(struct ioStatus *io, off64_t *offset, char *strIdx, int64_t *idx, int64_t *val) {
     if (strIdx[0] != '\0' && parseNum(strIdx, idx)) return 1;
     *val = 0;
@@ -176,23 +657,3176 @@ void printFD(int fd) {
     msg("+)\n");
 }
 
+uint64_t clockNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// start timing a system call, only if latencies are recorded
+uint64_t latStart(struct ioStatus *io) {
+    return io->lat == NULL ? 0 : clockNs();
+}
+
+// count a latency in its power of two bucket, may be called from several threads
+void latEnd(struct ioStatus *io, int kind, uint64_t t) {
+    struct latHist *h;
+    uint64_t max;
+    int b;
+    
+    if (t == 0) return;
+    h = &io->lat[kind];
+    t = clockNs() - t;
+    b = 63 - __builtin_clzll(t | 1);
+    if (b >= LAT_BUCKETS) b = LAT_BUCKETS - 1;
+    __atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->sum, t, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->buckets[b], 1, __ATOMIC_RELAXED);
+    max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    while (t > max && !__atomic_compare_exchange_n(&h->max, &max, t, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+int syncOut(struct ioStatus *io) {
+    uint64_t t = latStart(io);
+    int n = fsync(io->fdOut);
+    latEnd(io, LAT_SYNC, t);
+    return n;
+}
+
+void onHangup(int sig) {
+    limitReload = 1;
+}
+
+// limits file holds the byte rate and optionally the operation rate, 0 for no limit
+char readLimits(struct throttle *t) {
+    char buf[128], *rate, *ops, *save;
+    int64_t nRate, nOps = t->ops;
+    struct stat st;
+    int fd, n;
+    
+    if ((fd = open(t->path, O_RDONLY)) == -1 || fstat(fd, &st) == -1 || (n = read(fd, buf, sizeof(buf) - 1)) == -1) {
+        msg("failed to read limits file: %s: %s\n", t->path, strerror(errno));
+        if (fd != -1) close(fd);
+        return 1;
+    }
+    close(fd);
+    t->mtime = st.st_mtim;
+    buf[n] = '\0';
+    if ((rate = strtok_r(buf, " \t\n", &save)) == NULL || parseNum(rate, &nRate) || ((ops = strtok_r(NULL, " \t\n", &save)) != NULL && parseNum(ops, &nOps)) || nRate < 0 || nOps < 0) {
+        msg("bad limits in file: %s\n", t->path);
+        return 1;
+    }
+    if (t->bStatus && (nRate != t->rate || nOps != t->ops)) msg("limits: %'" PRId64 " bytes/s, %'" PRId64 " ops/s\n", nRate, nOps);
+    t->rate = nRate;
+    t->ops = nOps;
+    return 0;
+}
+
+// take tokens for an operation, waiting as long as the bucket is in debt
+void throttle(struct ioStatus *io, int bytes, int ops) {
+    struct throttle *t = io->limit;
+    struct stat st;
+    struct timespec ts;
+    uint64_t now;
+    double wait, dt;
+    int cancel;
+    
+    if (t == NULL) return;
+    // a cancelled reader thread must not leave the lock held, nanosleep and reading limits are cancellation points
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel);
+    pthread_mutex_lock(&t->lock);
+    t->tokRate -= bytes;
+    t->tokOps -= ops;
+    for (;;) {
+        now = clockNs();
+        if (t->path != NULL && (limitReload || now - t->tCheck >= 1000000000ULL)) {
+            // on a hangup signal or a changed file, at most once a second otherwise
+            t->tCheck = now;
+            if (limitReload || (stat(t->path, &st) == 0 && (st.st_mtim.tv_sec != t->mtime.tv_sec || st.st_mtim.tv_nsec != t->mtime.tv_nsec))) {
+                limitReload = 0;
+                readLimits(t);
+            }
+        }
+        
+        // refill, bursts are capped at a tenth of a second
+        dt = (now - t->tFill) / 1e9;
+        t->tFill = now;
+        t->tokRate += dt * t->rate;
+        t->tokOps += dt * t->ops;
+        if (t->rate == 0 || t->tokRate > t->rate / 10.0) t->tokRate = t->rate / 10.0;
+        if (t->ops == 0 || t->tokOps > t->ops / 10.0) t->tokOps = t->ops / 10.0;
+        
+        wait = 0;
+        if (t->tokRate < 0) wait = -t->tokRate / t->rate;
+        if (t->tokOps < 0 && -t->tokOps / t->ops > wait) wait = -t->tokOps / t->ops;
+        if (wait <= 0) break;
+        
+        // recheck limits at least once a second
+        if (wait > 1) wait = 1;
+        ts.tv_sec = wait;
+        ts.tv_nsec = (wait - ts.tv_sec) * 1e9;
+        nanosleep(&ts, NULL);
+    }
+    pthread_mutex_unlock(&t->lock);
+    pthread_setcancelstate(cancel, NULL);
+}
+
+// current rate is taken over at least a second, average rate over the whole run
+void updateRate(struct ioStatus *io, uint64_t now) {
+    if (now - io->tRate < 1000000000ULL) return;
+    io->rate = (io->out - io->outRate) * 1e9 / (now - io->tRate);
+    io->tRate = now;
+    io->outRate = io->out;
+}
+
+void printLatency(FILE *f, char *name, struct latHist *h) {
+    int i;
+    bool first = true;
+    fprintf(f, "\"%s\":{\"count\":%" PRIu64 ",\"total_ns\":%" PRIu64 ",\"max_ns\":%" PRIu64 ",\"buckets\":[", name, h->count, h->sum, h->max);
+    for (i = 0; i < LAT_BUCKETS; i++) {
+        if (h->buckets[i] == 0) continue;
+        fprintf(f, "%s{\"le_ns\":%" PRIu64 ",\"count\":%" PRIu64 "}", first ? "" : ",", (uint64_t)2 << i, h->buckets[i]);
+        first = false;
+    }
+    fprintf(f, "]}");
+}
+
+// one JSON object per line, the last one has final set
+void statsReport(struct ioStatus *io, bool final) {
+    static char *names[] = {"read", "write", "sync", "transfer"};
+    uint64_t now = clockNs(), rdNs, wrNs;
+    double elapsed = (now - io->tStart) / 1e9;
+    struct rusage ru;
+    int i;
+    
+    updateRate(io, now);
+    fprintf(io->stats, "{\"final\":%s,\"elapsed\":%.6f,\"reads\":%" PRIu64 ",\"writes\":%" PRIu64, final ? "true" : "false", elapsed, io->rd, io->wr);
+    fprintf(io->stats, ",\"bytes_in\":%" PRIu64 ",\"bytes_out\":%" PRIu64 ",\"bytes_cloned\":%" PRIu64, io->in, io->out, io->cloned);
+    fprintf(io->stats, ",\"bytes_compared\":%" PRIu64 ",\"bytes_skipped\":%" PRIu64, io->compared, io->skipped);
+    if (io->total != -1) fprintf(io->stats, ",\"bytes_total\":%" PRId64, io->total); else fprintf(io->stats, ",\"bytes_total\":null");
+    fprintf(io->stats, ",\"rate\":%.0f,\"rate_avg\":%.0f", io->rate, elapsed > 0 ? io->out / elapsed : 0);
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+        fprintf(io->stats, ",\"cpu_user\":%ld.%06ld,\"cpu_sys\":%ld.%06ld,\"max_rss_kb\":%ld", (long)ru.ru_utime.tv_sec, (long)ru.ru_utime.tv_usec, (long)ru.ru_stime.tv_sec, (long)ru.ru_stime.tv_usec, ru.ru_maxrss);
+    }
+    if (io->lat != NULL) {
+        // side that spent more time in system calls
+        rdNs = io->lat[LAT_READ].sum;
+        wrNs = io->lat[LAT_WRITE].sum + io->lat[LAT_SYNC].sum;
+        fprintf(io->stats, ",\"bound\":%s,\"latency\":{", rdNs == wrNs ? "null" : rdNs > wrNs ? "\"read\"" : "\"write\"");
+        for (i = 0; i < LAT_KINDS; i++) {
+            if (i > 0) fprintf(io->stats, ",");
+            printLatency(io->stats, names[i], &io->lat[i]);
+        }
+        fprintf(io->stats, "}");
+    }
+    fprintf(io->stats, "}\n");
+    fflush(io->stats);
+    io->statsNext = now + io->statsInt;
+}
+
 void printStats(struct ioStatus *io, char lineEnd) {
+    uint64_t now, eta;
+    double elapsed;
+    
     msg("reads/writes: %" PRIu64 "/%" PRIu64 ", bytes: %'" PRIu64 " in, %'" PRIu64 " out", io->rd, io->wr, io->in, io->out);
+    if (io->cloned) fprintf(stderr, " (%'" PRIu64 " cloned)", io->cloned);
+    if (io->compared) fprintf(stderr, " (%'" PRIu64 " compared, %'" PRIu64 " skipped)", io->compared, io->skipped);
     if (io->total != -1) {
         if (io->prog > 1) fprintf(stderr, ", %'" PRId64 " total", io->total);
         fprintf(stderr, " (%.1f%%)", io->total == 0 ? 100.0 : (int)((float)io->in / io->total * 1000) / 10.0);
     }
-    fprintf(stderr, "%c", lineEnd);
-    if (io->prog < 1) io->prog = 1;
+    now = clockNs();
+    elapsed = (now - io->tStart) / 1e9;
+    if (io->out > 0 && elapsed > 0) {
+        updateRate(io, now);
+        // progress shows the current rate and the time left at that rate
+        if (io->prog >= 0 && io->rate > 0) fprintf(stderr, ", %6.1f MB/s", io->rate / 1e6);
+        fprintf(stderr, io->prog >= 0 && io->rate > 0 ? " (avg %6.1f MB/s)" : ", %.1f MB/s", io->out / elapsed / 1e6);
+        if (io->prog >= 0 && io->rate > 0 && io->total != -1) {
+            eta = io->in < io->total ? (io->total - io->in) / io->rate : 0;
+            fprintf(stderr, ", ETA %" PRIu64 ":%02d:%02d", eta / 3600, (int)(eta / 60 % 60), (int)(eta % 60));
+        }
+    }
+    fprintf(stderr, "%c", lineEnd);
+    if (io->prog < 1) io->prog = 1;
+}
+
+void printProgress(struct ioStatus *io, struct copyJob *job) {
+    if (io->statsInt && clockNs() >= io->statsNext) statsReport(io, false);
+    if (io->prog >= 0) {
+        if (!job->bProgLF) fprintf(stderr, "\r");
+        printStats(io, job->bProgLF ? '\n' : ' ');
+    }
+}
+
+// checksums of the copied data, the fastest kernel for the CPU is picked on first use
+const uint32_t sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint8_t xxh3Secret[XXH3_SECRET] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e
+};
+
+uint32_t crc32cTable[8][256];
+uint32_t (*crc32cKernel)(uint32_t crc, const uint8_t *p, size_t len);
+void (*sha256Kernel)(uint32_t *state, const uint8_t *p, size_t blocks);
+void (*xxh3Kernel)(uint64_t *acc, const uint8_t *p, const uint8_t *secret, size_t stripes);
+
+uint64_t read64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return le64toh(v);
+}
+
+uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return le32toh(v);
+}
+
+// slicing by 8, 8 bytes per step
+uint32_t crc32cGeneric(uint32_t crc, const uint8_t *p, size_t len) {
+    uint64_t v;
+    for (; len >= 8; len -= 8, p += 8) {
+        v = read64(p) ^ crc;
+        crc = crc32cTable[7][v & 0xff] ^ crc32cTable[6][(v >> 8) & 0xff] ^ crc32cTable[5][(v >> 16) & 0xff] ^ crc32cTable[4][(v >> 24) & 0xff]
+            ^ crc32cTable[3][(v >> 32) & 0xff] ^ crc32cTable[2][(v >> 40) & 0xff] ^ crc32cTable[1][(v >> 48) & 0xff] ^ crc32cTable[0][v >> 56];
+    }
+    for (; len > 0; len--) crc = crc32cTable[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+void sha256Generic(uint32_t *state, const uint8_t *p, size_t blocks) {
+    uint32_t w[64], s[8], t1, t2;
+    int i;
+
+    for (; blocks > 0; blocks--, p += 64) {
+        for (i = 0; i < 16; i++) w[i] = (uint32_t)p[i * 4] << 24 | p[i * 4 + 1] << 16 | p[i * 4 + 2] << 8 | p[i * 4 + 3];
+        for (i = 16; i < 64; i++) {
+            w[i] = w[i - 16] + w[i - 7] + (ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3)) + (ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10));
+        }
+        memcpy(s, state, sizeof(s));
+        for (i = 0; i < 64; i++) {
+            t1 = s[7] + (ROR32(s[4], 6) ^ ROR32(s[4], 11) ^ ROR32(s[4], 25)) + ((s[4] & s[5]) ^ (~s[4] & s[6])) + sha256K[i] + w[i];
+            t2 = (ROR32(s[0], 2) ^ ROR32(s[0], 13) ^ ROR32(s[0], 22)) + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+            memmove(s + 1, s, 7 * sizeof(uint32_t));
+            s[4] += t1;
+            s[0] = t1 + t2;
+        }
+        for (i = 0; i < 8; i++) state[i] += s[i];
+    }
+}
+
+// 64 byte stripes, every accumulator takes the neighbouring input and the product of both keyed halves
+void xxh3Generic(uint64_t *acc, const uint8_t *p, const uint8_t *secret, size_t stripes) {
+    uint64_t v, k;
+    size_t s;
+    int i;
+    for (s = 0; s < stripes; s++, p += XXH3_STRIPE, secret += 8) {
+        for (i = 0; i < 8; i++) {
+            v = read64(p + i * 8);
+            k = v ^ read64(secret + i * 8);
+            acc[i ^ 1] += v;
+            acc[i] += (k & 0xffffffff) * (k >> 32);
+        }
+    }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t crc32cSse42(uint32_t crc, const uint8_t *p, size_t len) {
+    uint64_t c = crc;
+    for (; len >= 8; len -= 8, p += 8) c = _mm_crc32_u64(c, read64(p));
+    crc = c;
+    for (; len > 0; len--) crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+
+__attribute__((target("sha,sse4.1")))
+void sha256ShaNi(uint32_t *state, const uint8_t *p, size_t blocks) {
+    const __m128i swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i s0, s1, t, m, w[4], abef, cdgh;
+    int g;
+
+    // state words as ABEF and CDGH
+    t = _mm_shuffle_epi32(_mm_loadu_si128((__m128i *)&state[0]), 0xb1);
+    s1 = _mm_shuffle_epi32(_mm_loadu_si128((__m128i *)&state[4]), 0x1b);
+    s0 = _mm_alignr_epi8(t, s1, 8);
+    s1 = _mm_blend_epi16(s1, t, 0xf0);
+
+    for (; blocks > 0; blocks--, p += 64) {
+        abef = s0;
+        cdgh = s1;
+        for (g = 0; g < 16; g++) {
+            if (g < 4) {
+                w[g] = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)(p + g * 16)), swap);
+            } else {
+                t = _mm_add_epi32(_mm_sha256msg1_epu32(w[g & 3], w[(g + 1) & 3]), _mm_alignr_epi8(w[(g + 3) & 3], w[(g + 2) & 3], 4));
+                w[g & 3] = _mm_sha256msg2_epu32(t, w[(g + 3) & 3]);
+            }
+            m = _mm_add_epi32(w[g & 3], _mm_loadu_si128((__m128i *)&sha256K[g * 4]));
+            s1 = _mm_sha256rnds2_epu32(s1, s0, m);
+            s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(m, 0x0e));
+        }
+        s0 = _mm_add_epi32(s0, abef);
+        s1 = _mm_add_epi32(s1, cdgh);
+    }
+
+    t = _mm_shuffle_epi32(s0, 0x1b);
+    s1 = _mm_shuffle_epi32(s1, 0xb1);
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(t, s1, 0xf0));
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(s1, t, 8));
+}
+
+__attribute__((target("avx2")))
+void xxh3Avx2(uint64_t *acc, const uint8_t *p, const uint8_t *secret, size_t stripes) {
+    __m256i a[2], v, k;
+    size_t s;
+    int j;
+
+    a[0] = _mm256_loadu_si256((__m256i *)acc);
+    a[1] = _mm256_loadu_si256((__m256i *)(acc + 4));
+    for (s = 0; s < stripes; s++, p += XXH3_STRIPE, secret += 8) {
+        for (j = 0; j < 2; j++) {
+            v = _mm256_loadu_si256((__m256i *)(p + j * 32));
+            k = _mm256_xor_si256(v, _mm256_loadu_si256((__m256i *)(secret + j * 32)));
+            a[j] = _mm256_add_epi64(a[j], _mm256_shuffle_epi32(v, 0x4e));
+            a[j] = _mm256_add_epi64(a[j], _mm256_mul_epu32(k, _mm256_srli_epi64(k, 32)));
+        }
+    }
+    _mm256_storeu_si256((__m256i *)acc, a[0]);
+    _mm256_storeu_si256((__m256i *)(acc + 4), a[1]);
+}
+#endif
+
+void hashKernels() {
+    uint32_t c;
+    int i, j;
+#if defined(__x86_64__)
+    unsigned int eax, ebx, ecx, edx;
+#endif
+
+    if (crc32cKernel != NULL) return;
+    for (i = 0; i < 256; i++) {
+        for (c = i, j = 0; j < 8; j++) c = c & 1 ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+        crc32cTable[0][i] = c;
+    }
+    for (i = 0; i < 256; i++) {
+        for (j = 1; j < 8; j++) crc32cTable[j][i] = crc32cTable[0][crc32cTable[j - 1][i] & 0xff] ^ (crc32cTable[j - 1][i] >> 8);
+    }
+    crc32cKernel = crc32cGeneric;
+    sha256Kernel = sha256Generic;
+    xxh3Kernel = xxh3Generic;
+#if defined(__x86_64__)
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2)) crc32cKernel = crc32cSse42;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        // AVX2 also needs the OS to save the upper register halves
+        if ((ebx & bit_AVX2) && __builtin_cpu_supports("avx2")) xxh3Kernel = xxh3Avx2;
+        if ((ebx & bit_SHA) && crc32cKernel == crc32cSse42) sha256Kernel = sha256ShaNi;
+    }
+#endif
+}
+
+void hashStart(struct hash *h, char alg) {
+    static const uint32_t sha256Init[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    static const uint64_t xxh3Init[8] = {XXH_PRIME32_3, XXH_PRIME64_1, XXH_PRIME64_2, XXH_PRIME64_3, XXH_PRIME64_4, XXH_PRIME32_2, XXH_PRIME64_5, XXH_PRIME32_1};
+
+    hashKernels();
+    memset(h, 0, sizeof(*h));
+    h->alg = alg;
+    h->crc = 0xffffffff;
+    memcpy(h->sha, sha256Init, sizeof(h->sha));
+    memcpy(h->acc, xxh3Init, sizeof(h->acc));
+}
+
+// stripes of a block use the secret in steps of 8 bytes, the accumulators get scrambled after every block
+void xxh3Stripes(struct hash *h, const uint8_t *p, size_t stripes) {
+    size_t n;
+    uint64_t v;
+    int i;
+
+    while (stripes > 0) {
+        n = XXH3_BLOCK - h->stripes;
+        if (n > stripes) n = stripes;
+        xxh3Kernel(h->acc, p, xxh3Secret + h->stripes * 8, n);
+        h->stripes += n;
+        p += n * XXH3_STRIPE;
+        stripes -= n;
+        if (h->stripes == XXH3_BLOCK) {
+            for (i = 0; i < 8; i++) {
+                v = h->acc[i];
+                h->acc[i] = (v ^ (v >> 47) ^ read64(xxh3Secret + XXH3_SECRET - XXH3_STRIPE + i * 8)) * XXH_PRIME32_1;
+            }
+            h->stripes = 0;
+        }
+    }
+}
+
+void hashUpdate(struct hash *h, const void *data, size_t len) {
+    const uint8_t *p = data;
+    size_t n;
+
+    h->len += len;
+    if (h->alg == HASH_CRC32C) {
+        h->crc = crc32cKernel(h->crc, p, len);
+    } else if (h->alg == HASH_SHA256) {
+        if (h->buffered > 0) {
+            n = 64 - h->buffered < len ? 64 - h->buffered : len;
+            memcpy(h->buffer + h->buffered, p, n);
+            h->buffered += n;
+            p += n;
+            len -= n;
+            if (h->buffered == 64) {
+                sha256Kernel(h->sha, h->buffer, 1);
+                h->buffered = 0;
+            }
+        }
+        if (len >= 64) {
+            sha256Kernel(h->sha, p, len / 64);
+            p += len / 64 * 64;
+            len %= 64;
+        }
+        memcpy(h->buffer + h->buffered, p, len);
+        h->buffered += len;
+    } else {
+        // always keep the last bytes buffered for the final stripe
+        if (len <= XXH3_BUFFER - h->buffered) {
+            memcpy(h->buffer + h->buffered, p, len);
+            h->buffered += len;
+        } else {
+            if (h->buffered > 0) {
+                n = XXH3_BUFFER - h->buffered;
+                memcpy(h->buffer + h->buffered, p, n);
+                p += n;
+                len -= n;
+                xxh3Stripes(h, h->buffer, XXH3_BUFFER / XXH3_STRIPE);
+            }
+            if (len > XXH3_BUFFER) {
+                n = (len - 1) / XXH3_BUFFER * XXH3_BUFFER;
+                xxh3Stripes(h, p, n / XXH3_STRIPE);
+                memcpy(h->buffer + XXH3_BUFFER - XXH3_STRIPE, p + n - XXH3_STRIPE, XXH3_STRIPE);
+                p += n;
+                len -= n;
+            }
+            memcpy(h->buffer, p, len);
+            h->buffered = len;
+        }
+    }
+}
+
+// holes are hashed as the zeros they read as
+void hashZeros(struct hash *h, off64_t len) {
+    static const uint8_t zeros[4096];
+    for (; len > 0; len -= sizeof(zeros)) hashUpdate(h, zeros, len < (off64_t)sizeof(zeros) ? len : sizeof(zeros));
+}
+
+uint64_t xxh3Mul(uint64_t a, uint64_t b) {
+    __uint128_t p = (__uint128_t)a * b;
+    return (uint64_t)p ^ (uint64_t)(p >> 64);
+}
+
+uint64_t xxh3Avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= XXH_PRIME_MX1;
+    return h ^ (h >> 32);
+}
+
+uint64_t xxh64Avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    return h ^ (h >> 32);
+}
+
+uint64_t xxh3Mix16(const uint8_t *p, const uint8_t *secret) {
+    return xxh3Mul(read64(p) ^ read64(secret), read64(p + 8) ^ read64(secret + 8));
+}
+
+// inputs up to 240 bytes are hashed in one go, without accumulators
+uint64_t xxh3Short(const uint8_t *p, size_t len) {
+    const uint8_t *s = xxh3Secret;
+    uint64_t acc, end, lo, hi;
+    size_t i;
+
+    if (len == 0) return xxh64Avalanche(read64(s + 56) ^ read64(s + 64));
+    if (len <= 3) {
+        acc = (uint32_t)p[0] << 16 | (uint32_t)p[len >> 1] << 24 | p[len - 1] | (uint32_t)len << 8;
+        return xxh64Avalanche(acc ^ (read32(s) ^ read32(s + 4)));
+    }
+    if (len <= 8) {
+        acc = (read32(p + len - 4) + ((uint64_t)read32(p) << 32)) ^ (read64(s + 8) ^ read64(s + 16));
+        acc ^= ((acc << 49) | (acc >> 15)) ^ ((acc << 24) | (acc >> 40));
+        acc *= XXH_PRIME_MX2;
+        acc ^= (acc >> 35) + len;
+        acc *= XXH_PRIME_MX2;
+        return acc ^ (acc >> 28);
+    }
+    if (len <= 16) {
+        lo = read64(p) ^ (read64(s + 24) ^ read64(s + 32));
+        hi = read64(p + len - 8) ^ (read64(s + 40) ^ read64(s + 48));
+        return xxh3Avalanche(len + __builtin_bswap64(lo) + hi + xxh3Mul(lo, hi));
+    }
+    acc = len * XXH_PRIME64_1;
+    if (len <= 128) {
+        // pairs from both ends, working inwards
+        if (len > 32) {
+            if (len > 64) {
+                if (len > 96) acc += xxh3Mix16(p + 48, s + 96) + xxh3Mix16(p + len - 64, s + 112);
+                acc += xxh3Mix16(p + 32, s + 64) + xxh3Mix16(p + len - 48, s + 80);
+            }
+            acc += xxh3Mix16(p + 16, s + 32) + xxh3Mix16(p + len - 32, s + 48);
+        }
+        return xxh3Avalanche(acc + xxh3Mix16(p, s) + xxh3Mix16(p + len - 16, s + 16));
+    }
+    for (i = 0; i < 8; i++) acc += xxh3Mix16(p + i * 16, s + i * 16);
+    end = xxh3Mix16(p + len - 16, s + 136 - 17);
+    acc = xxh3Avalanche(acc);
+    for (i = 8; i < len / 16; i++) end += xxh3Mix16(p + i * 16, s + (i - 8) * 16 + 3);
+    return xxh3Avalanche(acc + end);
+}
+
+// digest as hexadecimal string, big-endian like the usual tools print it
+void hashDigest(struct hash *h, char *hex) {
+    struct hash f = *h;
+    uint8_t last[XXH3_STRIPE];
+    uint64_t v, bits;
+    int i, n;
+
+    if (f.alg == HASH_CRC32C) {
+        sprintf(hex, "%08" PRIx32, f.crc ^ 0xffffffff);
+    } else if (f.alg == HASH_SHA256) {
+        bits = f.len * 8;
+        f.buffer[f.buffered++] = 0x80;
+        if (f.buffered > 56) {
+            memset(f.buffer + f.buffered, 0, 64 - f.buffered);
+            sha256Kernel(f.sha, f.buffer, 1);
+            f.buffered = 0;
+        }
+        memset(f.buffer + f.buffered, 0, 56 - f.buffered);
+        for (i = 0; i < 8; i++) f.buffer[56 + i] = bits >> (56 - i * 8);
+        sha256Kernel(f.sha, f.buffer, 1);
+        for (i = 0; i < 8; i++) sprintf(hex + i * 8, "%08" PRIx32, f.sha[i]);
+    } else {
+        if (f.len <= 240) {
+            v = xxh3Short(f.buffer, f.len);
+        } else {
+            // the last stripe overlaps the previous one if needed
+            if (f.buffered >= XXH3_STRIPE) {
+                xxh3Stripes(&f, f.buffer, (f.buffered - 1) / XXH3_STRIPE);
+                memcpy(last, f.buffer + f.buffered - XXH3_STRIPE, XXH3_STRIPE);
+            } else {
+                n = XXH3_STRIPE - f.buffered;
+                memcpy(last, f.buffer + XXH3_BUFFER - n, n);
+                memcpy(last + n, f.buffer, f.buffered);
+            }
+            xxh3Kernel(f.acc, last, xxh3Secret + XXH3_SECRET - XXH3_STRIPE - 7, 1);
+            v = f.len * XXH_PRIME64_1;
+            for (i = 0; i < 4; i++) v += xxh3Mul(f.acc[i * 2] ^ read64(xxh3Secret + 11 + i * 16), f.acc[i * 2 + 1] ^ read64(xxh3Secret + 11 + i * 16 + 8));
+            v = xxh3Avalanche(v);
+        }
+        sprintf(hex, "%016" PRIx64, v);
+    }
+}
+
+const char *hashNames[] = {NULL, "crc32c", "xxh3", "sha256"};
+
+char hashAlg(char *name) {
+    if (strcmp(name, "crc32c") == 0) return HASH_CRC32C;
+    if (strcmp(name, "xxh3") == 0) return HASH_XXH3;
+    if (strcmp(name, "sha256") == 0) return HASH_SHA256;
+    msg("unknown checksum algorithm '%s'\n", name);
+    return 0;
+}
+
+// hash the bytes about to be written as input, the ones written as output
+void hashCopy(struct copyJob *job, void *buf, int rq, int wr) {
+    if (job->hashIn != NULL) hashUpdate(job->hashIn, buf, rq);
+    if (job->hashOut != NULL && wr > 0) hashUpdate(job->hashOut, buf, wr);
+}
+
+// hint sequential reading and start from the current positions
+void behindStart(struct ioStatus *io, struct copyJob *job) {
+    struct writeBehind *wb = job->behind;
+    off64_t in = lseek64(io->fdIn, 0, SEEK_CUR);
+    
+    wb->outFrom = wb->outDone = job->posOut;
+    wb->bIn = in != -1 && posix_fadvise(io->fdIn, 0, 0, POSIX_FADV_SEQUENTIAL) == 0;
+    wb->inShift = in - job->pos;
+    wb->inDone = wb->inAhead = in;
+}
+
+// start writeback of new output, wait for and drop output dist behind, read ahead and drop consumed input
+void behindFlush(struct ioStatus *io, struct copyJob *job, bool last) {
+    struct writeBehind *wb = job->behind;
+    off64_t end = last ? job->posOut : job->posOut - wb->dist, in;
+    uint64_t t;
+    
+    if (job->posOut > wb->outFrom && !last) {
+        sync_file_range(io->fdOut, wb->outFrom, job->posOut - wb->outFrom, SYNC_FILE_RANGE_WRITE);
+        wb->outFrom = job->posOut;
+    }
+    if (end > wb->outDone) {
+        t = latStart(io);
+        sync_file_range(io->fdOut, wb->outDone, end - wb->outDone, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        latEnd(io, LAT_SYNC, t);
+        posix_fadvise(io->fdOut, wb->outDone, end - wb->outDone, POSIX_FADV_DONTNEED);
+        wb->outDone = end;
+    }
+    if (!wb->bIn) return;
+    in = job->pos + wb->inShift;
+    if (in > wb->inDone) {
+        posix_fadvise(io->fdIn, wb->inDone, in - wb->inDone, POSIX_FADV_DONTNEED);
+        wb->inDone = in;
+    }
+    if (!last && in + wb->dist > wb->inAhead) {
+        if (wb->inAhead < in) wb->inAhead = in;
+        posix_fadvise(io->fdIn, wb->inAhead, in + wb->dist - wb->inAhead, POSIX_FADV_WILLNEED);
+        wb->inAhead = in + wb->dist;
+    }
+}
+
+// checksum of the LEN bytes of FD before OFF, to tell whether output still holds what the journal says
+char journalSum(struct journal *jn, int fd, off64_t off, int len, char *hex) {
+    struct hash h;
+    if (len > 0 && pread64(fd, jn->check, len, off - len) != len) return 1;
+    hashStart(&h, HASH_CRC32C);
+    hashUpdate(&h, jn->check, len);
+    hashDigest(&h, hex);
+    return 0;
+}
+
+// make output durable, then record how far it got, every interval and at the end
+void journalFlush(struct ioStatus *io, struct copyJob *job, bool last) {
+    struct journal *jn = job->journal;
+    off64_t in = jn->inFrom + (job->posOut - jn->outFrom);
+    char rec[512], hex[65];
+    int len, n, fd;
+    uint64_t t;
+
+    if (!last && job->posOut < jn->next) return;
+    jn->next = job->posOut + jn->interval;
+    t = latStart(io);
+    n = fdatasync(io->fdOut);
+    latEnd(io, LAT_SYNC, t);
+    if (n == -1) {
+        msgerr("failed to sync output for journal");
+        return;
+    }
+    len = in - jn->start < JOURNAL_CHECK ? in - jn->start : JOURNAL_CHECK;
+    if (journalSum(jn, io->fdIn, in + job->shiftIn, len, hex)) {
+        len = 0;
+        strcpy(hex, "-");
+    }
+    n = snprintf(rec, sizeof(rec), "bytecopy journal\nrange %" PRId64 " %" PRId64 "\nposition %" PRId64 " %" PRId64 "\nbytes %" PRIu64 " %" PRIu64 "\nops %" PRIu64 " %" PRIu64 "\ncheck %d %s\n",
+        jn->start, jn->end, in, job->posOut, jn->in + io->in, jn->out + io->out, jn->rd + io->rd, jn->wr + io->wr, len, hex);
+
+    // replaced by renaming, so it is never found half written
+    if ((fd = open(jn->tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) {
+        msg("failed to open journal: %s: %s\n", jn->tmp, strerror(errno));
+        return;
+    }
+    if (write(fd, rec, n) != n || fdatasync(fd) == -1) {
+        msg("failed to write journal: %s: %s\n", jn->tmp, strerror(errno));
+        close(fd);
+        return;
+    }
+    close(fd);
+    if (rename(jn->tmp, jn->path) == -1) {
+        msg("failed to replace journal: %s: %s\n", jn->path, strerror(errno));
+        return;
+    }
+    jn->count++;
+}
+
+// last checkpoint of an earlier run of the same range, -1 if there is none
+int journalLoad(struct journal *jn, off64_t *in, off64_t *out, int *len, char *hex) {
+    FILE *f = fopen(jn->path, "r");
+    int64_t start, end;
+    int n;
+
+    if (f == NULL) {
+        if (errno == ENOENT) return -1;
+        msg("failed to open journal: %s: %s\n", jn->path, strerror(errno));
+        return 1;
+    }
+    n = fscanf(f, "bytecopy journal range %" SCNd64 " %" SCNd64 " position %" SCNd64 " %" SCNd64 " bytes %" SCNu64 " %" SCNu64 " ops %" SCNu64 " %" SCNu64 " check %d %64s",
+        &start, &end, in, out, &jn->in, &jn->out, &jn->rd, &jn->wr, len, hex);
+    fclose(f);
+    if (n != 10 || *len < 0 || *len > JOURNAL_CHECK) {
+        msg("journal is damaged: %s\n", jn->path);
+        return 1;
+    }
+    if (start != jn->start || end != jn->end) {
+        msg("journal is for range %" PRId64 "..%" PRId64 ", not %" PRId64 "..%" PRId64 ": %s\n", start, end, jn->start, jn->end, jn->path);
+        return 1;
+    }
+    return 0;
+}
+
+int cycleLen(struct copyJob *job) {
+    return job->offEnd >= 0 && (job->pos + job->bufferLen) > job->offEnd ? job->offEnd - job->pos : job->blockSize;
+}
+
+bool copyZero(struct ioStatus *io, struct copyJob *job) {
+    static char *names[] = {"splice", "copy_file_range", "sendfile"};
+    struct stat stIn, stOut;
+    int method;
+    ssize_t n;
+    uint64_t t;
+    
+    // pick transfer method by file types
+    if (fstat(io->fdIn, &stIn) == -1 || fstat(io->fdOut, &stOut) == -1) {
+        job->engine = ENGINE_RW;
+        return false;
+    }
+    if (S_ISFIFO(stIn.st_mode) || S_ISFIFO(stOut.st_mode)) {
+        method = 0;
+    } else if (S_ISREG(stIn.st_mode) && S_ISREG(stOut.st_mode)) {
+        method = 1;
+    } else {
+        method = 2;
+    }
+    
+    do {
+        job->rq = cycleLen(job);
+        throttle(io, job->rq, 1);
+        t = latStart(io);
+        if (method == 0) {
+            n = splice(io->fdIn, NULL, io->fdOut, NULL, job->rq, SPLICE_F_MOVE);
+        } else if (method == 1) {
+            n = copy_file_range(io->fdIn, NULL, io->fdOut, NULL, job->rq, 0);
+        } else {
+            n = sendfile(io->fdOut, io->fdIn, NULL, job->rq);
+        }
+        latEnd(io, LAT_XFER, t);
+        if (n < 0) {
+            // let read/write take over (and report the actual error, if any)
+            if (job->bStatus) msg("%s failed (%s), falling back to read/write\n", names[method], strerror(errno));
+            job->engine = ENGINE_RW;
+            return false;
+        }
+        io->rd++;
+        io->in += n;
+        if (n > 0) {
+            io->wr++;
+            io->out += n;
+            if (job->posOut >= 0) job->posOut += n;
+            if (job->bSync && syncOut(io) == -1) msgerr("sync failed");
+        } else if (job->bWrEmpty) {
+            if (write(io->fdOut, io->buffer, 0) == -1) {
+                job->engine = ENGINE_RW;
+                return false;
+            }
+            io->wr++;
+        }
+        job->pos += n;
+        job->blockSize = job->bufferLen;
+        if (job->behind != NULL) behindFlush(io, job, false);
+        if (job->journal != NULL) journalFlush(io, job, false);
+        printProgress(io, job);
+    } while (n && (job->offEnd < 0 || job->pos < job->offEnd));
+    
+    job->rd = job->wr = job->rq = 0;
+    return true;
+}
+
+int blockAlign(int fd) {
+    struct stat st;
+    int n;
+    if (fstat(fd, &st) == -1) return 0;
+    if (S_ISBLK(st.st_mode) && ioctl(fd, BLKSSZGET, &n) == 0) return n;
+    return st.st_blksize;
+}
+
+char setDirect(int fd, bool on) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1) return 1;
+    return fcntl(fd, F_SETFL, on ? flags | O_DIRECT : flags & ~O_DIRECT) == -1;
+}
+
+// toggle direct I/O per operation, unaligned requests go through the page cache
+void alignDirect(int fd, struct copyJob *job, char which, off64_t off, void *buf, int len) {
+    bool on;
+    if (!(job->direct & which)) return;
+    on = off >= 0 && off % job->align == 0 && len % job->align == 0 && (uintptr_t)buf % job->align == 0;
+    if (on != ((job->directSet & which) != 0) && !setDirect(fd, on)) job->directSet ^= which;
+}
+
+int readIn(struct ioStatus *io, struct copyJob *job, void *buf, int len, off64_t off) {
+    uint64_t t;
+    int n;
+    throttle(io, 0, 1);
+    t = latStart(io);
+    alignDirect(io->fdIn, job, DIRECT_IN, off, buf, len);
+    n = read(io->fdIn, buf, len);
+    latEnd(io, LAT_READ, t);
+    return n;
+}
+
+int writeRaw(struct ioStatus *io, struct copyJob *job, void *buf, int len) {
+    uint64_t t;
+    int n;
+    throttle(io, len, 1);
+    t = latStart(io);
+    alignDirect(io->fdOut, job, DIRECT_OUT, job->posOut, buf, len);
+    n = write(io->fdOut, buf, len);
+    latEnd(io, LAT_WRITE, t);
+    if (n > 0 && job->posOut >= 0) job->posOut += n;
+    if (job->posOut > job->sizeOut) job->sizeOut = job->posOut;
+    return n;
+}
+
+bool isZero(void *buf, size_t len) {
+    // overlapping compare runs on the vectorized memcmp of the C library
+    return len == 0 || (*(char *)buf == 0 && memcmp(buf, buf + 1, len - 1) == 0);
+}
+
+// leave a hole of len bytes in the output, punching out existing data
+char holeOut(struct ioStatus *io, struct copyJob *job, off64_t len) {
+    off64_t n = job->sizeOut - job->posOut;
+    if (n > len) n = len;
+    if (n > 0 && fallocate64(io->fdOut, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, job->posOut, n) == -1) return 1;
+    if (lseek64(io->fdOut, job->posOut + len, SEEK_SET) == -1) return 1;
+    job->posOut += len;
+    return 0;
+}
+
+// write zeros for len bytes, for when no hole can be made
+char zeroOut(struct ioStatus *io, struct copyJob *job, off64_t len) {
+    int n;
+    memset(io->buffer, 0, len < job->bufferLen ? len : job->bufferLen);
+    for (; len > 0; len -= n) {
+        if ((n = writeRaw(io, job, io->buffer, len < job->bufferLen ? len : job->bufferLen)) <= 0) return 1;
+    }
+    return 0;
+}
+
+// write runs of data and skip runs of zeros, in blocks of the output file system
+int writeSparse(struct ioStatus *io, struct copyJob *job, void *buf, int len) {
+    int done, run, next, n;
+    bool zero;
+    for (done = 0; done < len; done += run) {
+        run = job->sparseBlock - job->posOut % job->sparseBlock;
+        if (run > len - done) run = len - done;
+        zero = isZero(buf + done, run);
+        while (done + run < len) {
+            next = len - done - run < job->sparseBlock ? len - done - run : job->sparseBlock;
+            if (isZero(buf + done + run, next) != zero) break;
+            run += next;
+        }
+        if (zero && !holeOut(io, job, run)) continue;
+        n = writeRaw(io, job, buf + done, run);
+        if (n < 0) return -1;
+        if (n < run) return done + n;
+    }
+    return done;
+}
+
+// compare with what the output already holds and write only the blocks that differ
+int writeDelta(struct ioStatus *io, struct copyJob *job, void *buf, int len) {
+    int done, run, next, have, n;
+    off64_t skip = 0;
+    bool same;
+    
+    for (have = 0; have < len; have += n) {
+        alignDirect(io->fdOut, job, DIRECT_OUT, job->posOut + have, job->deltaBuf + have, len - have);
+        n = pread64(io->fdOut, job->deltaBuf + have, len - have, job->posOut + have);
+        if (n < 0) return -1;
+        if (n == 0) break;
+    }
+    io->compared += have;
+    
+    for (done = 0; done < len; done += run) {
+        run = job->deltaBlock - job->posOut % job->deltaBlock;
+        if (run > len - done) run = len - done;
+        same = done + run <= have && memcmp(buf + done, job->deltaBuf + done, run) == 0;
+        while (done + run < len) {
+            next = len - done - run < job->deltaBlock ? len - done - run : job->deltaBlock;
+            if ((done + run + next <= have && memcmp(buf + done + run, job->deltaBuf + done + run, next) == 0) != same) break;
+            run += next;
+        }
+        if (same) {
+            // seek only once the next write or the end of the cycle is reached
+            skip += run;
+            job->posOut += run;
+            io->skipped += run;
+            continue;
+        }
+        if (skip > 0 && lseek64(io->fdOut, job->posOut, SEEK_SET) == -1) return -1;
+        skip = 0;
+        n = writeRaw(io, job, buf + done, run);
+        if (n < 0) return -1;
+        if (n < run) return done + n;
+    }
+    if (skip > 0 && lseek64(io->fdOut, job->posOut, SEEK_SET) == -1) return -1;
+    return done;
+}
+
+// bytes with escapes \n, \r, \t, \0, \\ and \xHH, WHAT names them in messages
+char parseBytes(char *str, uint8_t *buf, int *len, int max, char *what) {
+    for (*len = 0; *str; (*len)++) {
+        if (*len == max) {
+            msg("%s is longer than %d bytes\n", what, max);
+            return 1;
+        }
+        if (*str != '\\') {
+            buf[*len] = *str++;
+            continue;
+        }
+        switch (*++str) {
+            case 'n': buf[*len] = '\n'; break;
+            case 'r': buf[*len] = '\r'; break;
+            case 't': buf[*len] = '\t'; break;
+            case '0': buf[*len] = '\0'; break;
+            case '\\': buf[*len] = '\\'; break;
+            case 'x':
+                if (!isxdigit(str[1]) || !isxdigit(str[2])) {
+                    msg("\\x needs two hexadecimal digits\n");
+                    return 1;
+                }
+                buf[*len] = strtol((char[]){str[1], str[2], '\0'}, NULL, 16);
+                str += 2;
+                break;
+            default:
+                msg("unknown escape sequence in %s\n", what);
+                return 1;
+        }
+        str++;
+    }
+    if (*len == 0) {
+        msg("%s must not be empty\n", what);
+        return 1;
+    }
+    return 0;
+}
+
+char parseDelim(struct indexGen *ix, char *str) {
+    return parseBytes(str, ix->delim, &ix->delimLen, INDEX_DELIM_MAX, "delimiter");
+}
+
+// first candidate by the vectorized memchr of the C library, then compare the rest
+const uint8_t *findDelimGeneric(const uint8_t *p, size_t len, const uint8_t *d, int dLen) {
+    const uint8_t *q, *end;
+    if (len < (size_t)dLen) return NULL;
+    for (end = p + len - dLen + 1; (q = memchr(p, d[0], end - p)) != NULL; p = q + 1) {
+        if (memcmp(q + 1, d + 1, dLen - 1) == 0) return q;
+    }
+    return NULL;
+}
+
+#if defined(__x86_64__)
+// 32 positions at a time, matching both the first and the last byte of the delimiter
+__attribute__((target("avx2")))
+const uint8_t *findDelimAvx2(const uint8_t *p, size_t len, const uint8_t *d, int dLen) {
+    __m256i first = _mm256_set1_epi8(d[0]), last = _mm256_set1_epi8(d[dLen - 1]);
+    uint32_t mask;
+    size_t i;
+    int bit;
+
+    for (i = 0; i + dLen - 1 + 32 <= len; i += 32) {
+        mask = _mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(first, _mm256_loadu_si256((__m256i *)(p + i))),
+            _mm256_cmpeq_epi8(last, _mm256_loadu_si256((__m256i *)(p + i + dLen - 1)))));
+        for (; mask; mask &= mask - 1) {
+            bit = __builtin_ctz(mask);
+            if (memcmp(p + i + bit + 1, d + 1, dLen - 2) == 0) return p + i + bit;
+        }
+    }
+    return findDelimGeneric(p + i, len - i, d, dLen);
+}
+#endif
+
+const uint8_t *(*findDelim)(const uint8_t *p, size_t len, const uint8_t *d, int dLen);
+
+void indexStart(struct indexGen *ix, off64_t pos) {
+    findDelim = findDelimGeneric;
+#if defined(__x86_64__)
+    if (ix->delimLen > 1 && __builtin_cpu_supports("avx2")) findDelim = findDelimAvx2;
+#endif
+    ix->pos = ix->next = pos;
+    ix->pending = -1;
+}
+
+char indexFlush(struct ioStatus *io, struct copyJob *job, struct indexGen *ix) {
+    int done, n;
+    for (done = 0; done < ix->fill * 8; done += n) {
+        if ((n = writeRaw(io, job, (void *)ix->entries + done, ix->fill * 8 - done)) <= 0) {
+            if (n == 0) errno = ENOSPC;
+            return 1;
+        }
+    }
+    ix->fill = 0;
+    return 0;
+}
+
+// values in the form readIdx takes them back
+char indexPut(struct ioStatus *io, struct copyJob *job, struct indexGen *ix, off64_t pos) {
+    uint64_t val = pos - io->offsetIn;
+    if (io->endian == 'u') {
+        val = htole64(val);
+    } else if (io->endian == 'U') {
+        val = htobe64(val);
+    }
+    ix->entries[ix->fill++] = val;
+    ix->count++;
+    return ix->fill == INDEX_BATCH ? indexFlush(io, job, ix) : 0;
+}
+
+// a boundary is only written once known not to be the end of input
+char indexAdd(struct ioStatus *io, struct copyJob *job, struct indexGen *ix, off64_t pos) {
+    if (ix->pending >= 0 && indexPut(io, job, ix, ix->pending)) return 1;
+    ix->pending = ix->next = pos;
+    return 0;
+}
+
+char indexDelim(struct ioStatus *io, struct copyJob *job, struct indexGen *ix, const uint8_t *buf, int len) {
+    uint8_t span[2 * INDEX_DELIM_MAX];
+    const uint8_t *q;
+    off64_t base = ix->pos;
+    int from, i, n;
+
+    // a delimiter may span from the previous cycle into this one
+    if (ix->carryLen > 0) {
+        n = len < ix->delimLen - 1 ? len : ix->delimLen - 1;
+        memcpy(span, ix->carry, ix->carryLen);
+        memcpy(span + ix->carryLen, buf, n);
+        for (i = 0; i < ix->carryLen && i + ix->delimLen <= ix->carryLen + n; i++) {
+            if (base - ix->carryLen + i >= ix->next && memcmp(span + i, ix->delim, ix->delimLen) == 0) {
+                if (indexAdd(io, job, ix, base - ix->carryLen + i + ix->delimLen)) return 1;
+                break;
+            }
+        }
+    }
+
+    for (from = ix->next > base ? ix->next - base : 0; from < len && (q = findDelim(buf + from, len - from, ix->delim, ix->delimLen)) != NULL; from = q - buf + ix->delimLen) {
+        if (indexAdd(io, job, ix, base + (q - buf) + ix->delimLen)) return 1;
+    }
+
+    // keep what could be the start of a delimiter
+    n = ix->carryLen + len < ix->delimLen - 1 ? ix->carryLen + len : ix->delimLen - 1;
+    if (len >= n) {
+        memcpy(ix->carry, buf + len - n, n);
+    } else {
+        memmove(ix->carry, ix->carry + ix->carryLen - (n - len), n - len);
+        memcpy(ix->carry + n - len, buf, len);
+    }
+    ix->carryLen = n;
+    return 0;
+}
+
+char indexHeader(struct ioStatus *io, struct copyJob *job, struct indexGen *ix, const uint8_t *buf, int len) {
+    const uint8_t *hdr;
+    off64_t end = ix->pos + len, n;
+    uint64_t val;
+    int i;
+
+    while (ix->next < end) {
+        if (ix->carryLen > 0 || ix->next + ix->size > end) {
+            // header split between cycles
+            n = ix->size - ix->carryLen;
+            if (n > end - (ix->next + ix->carryLen)) n = end - (ix->next + ix->carryLen);
+            memcpy(ix->carry + ix->carryLen, buf + (ix->next + ix->carryLen - ix->pos), n);
+            ix->carryLen += n;
+            if (ix->carryLen < ix->size) break;
+            ix->carryLen = 0;
+            hdr = ix->carry;
+        } else hdr = buf + (ix->next - ix->pos);
+        for (val = 0, i = 0; i < ix->size; i++) {
+            val |= (uint64_t)hdr[io->endian == 'U' || (io->endian != 'u' && __BYTE_ORDER == __BIG_ENDIAN) ? ix->size - 1 - i : i] << (8 * i);
+        }
+        if (val > INT64_MAX / 2 || (int64_t)val + ix->adjust <= 0) {
+            msg("record at offset %" PRId64 " has invalid length %" PRIu64 "\n", ix->next, val);
+            errno = EBADMSG;
+            return 1;
+        }
+        if (indexAdd(io, job, ix, ix->next + val + ix->adjust)) return 1;
+    }
+    return 0;
+}
+
+// write boundaries found in the cycle to output instead of the data
+int writeIndex(struct ioStatus *io, struct copyJob *job, void *buf, int len) {
+    struct indexGen *ix = job->index;
+    if (ix->mode == INDEX_DELIM && indexDelim(io, job, ix, buf, len)) return -1;
+    if (ix->mode == INDEX_HEADER && indexHeader(io, job, ix, buf, len)) return -1;
+    if (ix->mode == INDEX_SIZE) {
+        while (ix->next + ix->size <= ix->pos + len) {
+            if (indexAdd(io, job, ix, ix->next + ix->size)) return -1;
+        }
+    }
+    ix->pos += len;
+    return len;
+}
+
+// last boundary unless it is the end of input, then whatever is batched
+char indexEnd(struct ioStatus *io, struct copyJob *job) {
+    struct indexGen *ix = job->index;
+    if (ix->pending >= 0 && ix->pending < ix->pos && indexPut(io, job, ix, ix->pending)) return 1;
+    return indexFlush(io, job, ix);
+}
+
+// whether writing WR bytes issued a write, not so if a delta copy found them all unchanged since SKIPPED was taken
+bool wroteOut(struct ioStatus *io, uint64_t skipped, int wr) {
+    return wr <= 0 || io->skipped - skipped < (uint64_t)wr;
+}
+
+int writeOut(struct ioStatus *io, struct copyJob *job, void *buf, int len) {
+    if (job->index != NULL) return writeIndex(io, job, buf, len);
+    if (job->deltaBuf != NULL) return writeDelta(io, job, buf, len);
+    if (job->bSparse) return writeSparse(io, job, buf, len);
+    return writeRaw(io, job, buf, len);
+}
+
+// length of the hole at the current input position within the range, -1 if it cannot be determined
+off64_t sparseHole(struct ioStatus *io, struct copyJob *job) {
+    off64_t cur = lseek64(io->fdIn, 0, SEEK_CUR), data, hole, n;
+    if (cur == -1) return -1;
+    data = lseek64(io->fdIn, cur, SEEK_DATA);
+    if (data == -1) {
+        // nothing but a hole up to the end of input
+        if (errno != ENXIO || (data = lseek64(io->fdIn, 0, SEEK_END)) == -1) return -1;
+        if (data < cur) data = cur;
+        hole = data;
+    } else if ((hole = lseek64(io->fdIn, data, SEEK_HOLE)) == -1) return -1;
+    n = data - cur;
+    if (job->offEnd >= 0 && n > job->offEnd - job->pos) n = job->offEnd - job->pos;
+    job->dataEnd = job->pos + (hole - cur);
+    if (lseek64(io->fdIn, cur + n, SEEK_SET) == -1) return -1;
+    return n;
+}
+
+void *allocBuffer(size_t len, int align) {
+    void *p;
+    long page = sysconf(_SC_PAGESIZE);
+    if (align <= 0) return malloc(len);
+    if ((errno = posix_memalign(&p, align > page ? align : page, len))) return NULL;
+    return p;
+}
+
+void *ringReader(void *arg) {
+    struct ring *r = arg;
+    struct ringSlot *slot;
+    int i = 0, rq;
+    bool last;
+    
+    do {
+        sem_wait(&r->free);
+        if (__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) break;
+        slot = &r->slots[i];
+        slot->len = slot->reads = 0;
+        do {
+            rq = cycleLen(&r->job) - slot->len;
+            slot->rd = readIn(r->io, &r->job, slot->buffer + slot->len, rq, r->job.pos + r->job.shiftIn + slot->len);
+            slot->err = errno;
+            slot->reads++;
+            if (slot->rd > 0) slot->len += slot->rd;
+        } while (slot->rd > 0 && slot->rd < rq && !r->job.bFlushEach);
+        r->job.pos += slot->len;
+        r->job.blockSize = r->job.bufferLen;
+        last = slot->rd <= 0 || (r->job.offEnd >= 0 && r->job.pos >= r->job.offEnd);
+        slot->last = last;
+        sem_post(&r->full);
+        i = (i + 1) % r->job.buffers;
+    } while (!last);
+    return NULL;
+}
+
+bool copyThreaded(struct ioStatus *io, struct copyJob *job) {
+    struct ring r = {io, *job, NULL};
+    struct ringSlot *slot;
+    pthread_t reader;
+    uint64_t skipped;
+    int i, err = 0;
+    bool last = false;
+    
+    // buffers beyond the first one are allocated alike
+    r.slots = calloc(job->buffers, sizeof(struct ringSlot));
+    r.slots[0].buffer = io->buffer;
+    for (i = 1; i < job->buffers; i++) {
+        if ((r.slots[i].buffer = allocBuffer(job->bufferLen, job->direct ? job->align : 0)) == NULL) break;
+    }
+    if (i < job->buffers || sem_init(&r.free, 0, job->buffers) || sem_init(&r.full, 0, 0) || (errno = pthread_create(&reader, NULL, ringReader, &r))) {
+        if (job->bStatus) msg("failed to set up reader thread (%s), falling back to read/write\n", strerror(errno));
+        while (--i > 0) free(r.slots[i].buffer);
+        free(r.slots);
+        job->engine = ENGINE_RW;
+        return false;
+    }
+    
+    i = 0;
+    do {
+        sem_wait(&r.full);
+        slot = &r.slots[i];
+        io->rd += slot->reads;
+        io->in += slot->len;
+        job->rd = slot->rd;
+        if (slot->rd < 0) {
+            err = slot->err;
+            break;
+        }
+        job->rq = slot->len;
+        if (job->rq > 0 || job->bWrEmpty) {
+            skipped = io->skipped;
+            job->wr = writeOut(io, job, slot->buffer, job->rq);
+            if (job->wr == -1) err = errno;
+            if (wroteOut(io, skipped, job->wr)) {
+                if (job->bSync && job->wr != -1 && syncOut(io) == -1) msgerr("sync failed");
+                io->wr++;
+            }
+        } else job->wr = 0;
+        hashCopy(job, slot->buffer, job->rq, job->wr);
+        if (job->wr < 0 || job->wr != job->rq) break;
+        io->out += job->wr;
+        job->pos += slot->len;
+        job->blockSize = job->bufferLen;
+        if (job->behind != NULL) behindFlush(io, job, false);
+        if (job->journal != NULL) journalFlush(io, job, false);
+        last = slot->last;
+        sem_post(&r.free);
+        printProgress(io, job);
+        i = (i + 1) % job->buffers;
+    } while (!last);
+    
+    // stop reader, unless it already finished
+    if (!last) {
+        __atomic_store_n(&r.stop, true, __ATOMIC_RELEASE);
+        pthread_cancel(reader);
+        sem_post(&r.free);
+    }
+    pthread_join(reader, NULL);
+    sem_destroy(&r.free);
+    sem_destroy(&r.full);
+    for (i = 1; i < job->buffers; i++) free(r.slots[i].buffer);
+    free(r.slots);
+    errno = err;
+    return true;
+}
+
+char uringInit(struct uring *u, unsigned entries) {
+    struct io_uring_params p;
+    
+    memset(&p, 0, sizeof(p));
+    memset(u, 0, sizeof(*u));
+    if ((u->fd = syscall(__NR_io_uring_setup, entries, &p)) == -1) return 1;
+    u->sqRingLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cqRingLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    u->sqesLen = p.sq_entries * sizeof(struct io_uring_sqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cqRingLen > u->sqRingLen) u->sqRingLen = u->cqRingLen;
+        u->cqRingLen = 0;
+    }
+    u->sqRing = mmap(NULL, u->sqRingLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    u->cqRing = u->cqRingLen == 0 ? u->sqRing : mmap(NULL, u->cqRingLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+    u->sqes = mmap(NULL, u->sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqRing == MAP_FAILED || u->cqRing == MAP_FAILED || u->sqes == MAP_FAILED) {
+        close(u->fd);
+        return 1;
+    }
+    u->sqTail = u->sqRing + p.sq_off.tail;
+    u->sqMask = u->sqRing + p.sq_off.ring_mask;
+    u->sqArray = u->sqRing + p.sq_off.array;
+    u->cqHead = u->cqRing + p.cq_off.head;
+    u->cqTail = u->cqRing + p.cq_off.tail;
+    u->cqMask = u->cqRing + p.cq_off.ring_mask;
+    u->cqes = u->cqRing + p.cq_off.cqes;
+    u->tail = *u->sqTail;
+    return 0;
+}
+
+void uringFree(struct uring *u) {
+    munmap(u->sqes, u->sqesLen);
+    if (u->cqRingLen) munmap(u->cqRing, u->cqRingLen);
+    munmap(u->sqRing, u->sqRingLen);
+    close(u->fd);
+}
+
+struct io_uring_sqe *uringSqe(struct uring *u, char op, int fd, uint64_t data) {
+    unsigned idx = u->tail++ & *u->sqMask;
+    struct io_uring_sqe *sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->user_data = data;
+    u->sqArray[idx] = idx;
+    u->pending++;
+    return sqe;
+}
+
+int uringSubmit(struct uring *u, unsigned wait) {
+    int n;
+    __atomic_store_n(u->sqTail, u->tail, __ATOMIC_RELEASE);
+    do {
+        n = syscall(__NR_io_uring_enter, u->fd, u->pending, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (n == -1 && errno == EINTR);
+    if (n > 0) u->pending -= n;
+    return n;
+}
+
+// queue a read or write of a slot's remaining bytes, followed by a linked fsync if requested
+void uringQueue(struct uring *u, struct uringCopy *uc, int i, bool wr) {
+    struct uringSlot *slot = &uc->slots[i];
+    struct io_uring_sqe *sqe;
+    int done = wr ? slot->written : slot->len;
+    off64_t base = wr ? uc->outBase : uc->inBase;
+    
+    throttle(uc->io, wr ? slot->len - done : 0, 1);
+    sqe = uringSqe(u, uc->fixed ? (wr ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED) : (wr ? IORING_OP_WRITE : IORING_OP_READ), wr ? uc->io->fdOut : uc->io->fdIn, i * 4 + wr);
+    sqe->addr = (uintptr_t)(slot->buffer + done);
+    sqe->len = (wr ? slot->len : slot->rq) - done;
+    sqe->off = base == -1 ? (uint64_t)-1 : base + (wr ? slot->pos - uc->start : slot->pos) + done;
+    sqe->buf_index = i;
+    if (wr && uc->job->bSync) {
+        sqe->flags |= IOSQE_IO_LINK;
+        uringSqe(u, IORING_OP_FSYNC, uc->io->fdOut, i * 4 + 2);
+    }
+    slot->state = wr ? SLOT_WRITING : SLOT_READING;
+}
+
+// direct I/O has to stay aligned, leave head and tail to read/write
+bool directAligned(struct copyJob *job, off64_t *end) {
+    if (!job->direct) return true;
+    if (((job->direct & DIRECT_IN) && (job->pos + job->shiftIn) % job->align) || ((job->direct & DIRECT_OUT) && job->posOut % job->align) || job->blockSize % job->align) return false;
+    if (*end >= 0) *end -= (*end - job->pos) % job->align;
+    return true;
+}
+
+bool copyUring(struct ioStatus *io, struct copyJob *job) {
+    struct uring u;
+    struct uringCopy uc = {io, job, NULL, job->pos, -1, -1, false};
+    struct uringSlot *slot;
+    struct io_uring_cqe *cqe;
+    struct iovec *iov;
+    off64_t next = job->pos, end = job->offEnd, done = job->pos;
+    uint64_t seq = 0, seqWrite = 0, seqEnd = UINT64_MAX;
+    unsigned head;
+    int i, n, inflight = 0, reading = 0, writing = 0, err = 0, flags;
+    bool seekOut, eof = false;
+    void *mem;
+    
+    // positions to use with explicit offsets, -1 for sequential access
+    uc.inBase = lseek64(io->fdIn, 0, SEEK_CUR);
+    if (uc.inBase != -1) uc.inBase -= job->pos;
+    uc.outBase = lseek64(io->fdOut, 0, SEEK_CUR);
+    flags = fcntl(io->fdOut, F_GETFL);
+    if (flags == -1 || flags & O_APPEND) uc.outBase = -1;
+    seekOut = uc.outBase != -1;
+    
+    if (!directAligned(job, &end)) return false;
+    
+    if (uringInit(&u, job->depth * 2)) {
+        if (job->bStatus) msg("io_uring not available (%s), falling back to read/write\n", strerror(errno));
+        job->engine = ENGINE_RW;
+        return false;
+    }
+    if ((mem = allocBuffer((size_t)job->bufferLen * job->depth, job->direct ? job->align : 1)) == NULL) {
+        if (job->bStatus) msg("failed to allocate io_uring buffers, falling back to read/write\n");
+        job->engine = ENGINE_RW;
+        uringFree(&u);
+        return false;
+    }
+    uc.slots = calloc(job->depth, sizeof(struct uringSlot));
+    iov = calloc(job->depth, sizeof(struct iovec));
+    for (i = 0; i < job->depth; i++) {
+        uc.slots[i].buffer = iov[i].iov_base = mem + (size_t)i * job->bufferLen;
+        iov[i].iov_len = job->bufferLen;
+    }
+    uc.fixed = syscall(__NR_io_uring_register, u.fd, IORING_REGISTER_BUFFERS, iov, job->depth) == 0;
+    free(iov);
+    
+    while (true) {
+        // fill free slots with reads, only one at a time if input is sequential
+        for (i = 0; i < job->depth && !eof && seq < seqEnd && (end < 0 || next < end); i++) {
+            slot = &uc.slots[i];
+            if (slot->state != SLOT_FREE || (uc.inBase == -1 && reading)) continue;
+            slot->pos = next;
+            slot->rq = seq == 0 ? job->blockSize : job->bufferLen;
+            if (end >= 0 && next + slot->rq > end) slot->rq = end - next;
+            slot->seq = seq++;
+            slot->len = slot->written = slot->reads = 0;
+            uringQueue(&u, &uc, i, false);
+            next += slot->rq;
+            reading++;
+            inflight++;
+        }
+        // write completed reads, in order if output is sequential
+        for (i = 0; i < job->depth; i++) {
+            slot = &uc.slots[i];
+            if (slot->state != SLOT_READ) continue;
+            if (slot->seq >= seqEnd) {
+                slot->state = SLOT_FREE;
+                continue;
+            }
+            if (!seekOut && (writing || slot->seq != seqWrite)) continue;
+            if ((job->directSet & DIRECT_OUT) && slot->len % job->align) {
+                // unaligned tail, write through the page cache once everything else is done
+                if (inflight) continue;
+                setDirect(io->fdOut, false);
+                job->directSet &= ~DIRECT_OUT;
+            }
+            io->in += slot->len;
+            io->rd += slot->reads;
+            if (slot->len == 0) {
+                slot->state = SLOT_FREE;
+                seqWrite++;
+                continue;
+            }
+            uringQueue(&u, &uc, i, true);
+            writing++;
+            inflight += job->bSync ? 2 : 1;
+        }
+        if (inflight == 0) break;
+        if (uringSubmit(&u, 1) < 0) {
+            err = errno;
+            job->wr = -1;
+            break;
+        }
+        
+        // reap completions
+        head = *u.cqHead;
+        while (head != __atomic_load_n(u.cqTail, __ATOMIC_ACQUIRE)) {
+            cqe = &u.cqes[head++ & *u.cqMask];
+            slot = &uc.slots[cqe->user_data / 4];
+            n = cqe->res;
+            switch (cqe->user_data % 4) {
+                case 0:
+                    // read
+                    slot->reads++;
+                    if (n < 0) {
+                        io->rd++;
+                        if (slot->seq < seqEnd) {
+                            seqEnd = slot->seq;
+                            job->rd = -1;
+                            err = -n;
+                        }
+                        n = 0;
+                    }
+                    slot->len += n;
+                    if (n > 0 && slot->len < slot->rq && (uc.inBase != -1 || !job->bFlushEach)) {
+                        // partial read, complete the slot
+                        uringQueue(&u, &uc, slot - uc.slots, false);
+                        continue;
+                    }
+                    if (slot->len < slot->rq && slot->seq < seqEnd) {
+                        if (uc.inBase == -1 && n > 0) {
+                            // short read from sequential input, continue right after it
+                            next = slot->pos + slot->len;
+                        } else {
+                            eof = true;
+                            if (slot->seq + 1 < seqEnd) seqEnd = slot->seq + 1;
+                        }
+                    }
+                    slot->state = SLOT_READ;
+                    reading--;
+                    inflight--;
+                    break;
+                case 1:
+                    // write, the rest of a partial one is queued again like read/write continues it
+                    io->wr++;
+                    if (n > 0) {
+                        io->out += n;
+                        slot->written += n;
+                        if (slot->written < slot->len) {
+                            uringQueue(&u, &uc, slot - uc.slots, true);
+                            if (job->bSync) inflight++;
+                            continue;
+                        }
+                    } else {
+                        job->wr = n < 0 ? -1 : 0;
+                        job->rq = slot->len - slot->written;
+                        if (n < 0) err = -n;
+                        seqEnd = 0;
+                    }
+                    done += slot->len;
+                    slot->state = job->bSync ? SLOT_SYNCING : SLOT_FREE;
+                    seqWrite++;
+                    writing--;
+                    inflight--;
+                    break;
+                case 2:
+                    // linked fsync, cancelled if the write was short and queued again
+                    if (n < 0 && n != -ECANCELED) {
+                        errno = -n;
+                        msgerr("sync failed");
+                    }
+                    if (slot->state == SLOT_SYNCING) slot->state = SLOT_FREE;
+                    inflight--;
+                    break;
+            }
+        }
+        __atomic_store_n(u.cqHead, head, __ATOMIC_RELEASE);
+        job->pos = done;
+        printProgress(io, job);
+    }
+    
+    // leave file positions as read/write would
+    if (uc.inBase != -1) lseek64(io->fdIn, uc.inBase + done, SEEK_SET);
+    if (seekOut) lseek64(io->fdOut, uc.outBase + (done - uc.start), SEEK_SET);
+    if (job->posOut >= 0) job->posOut += done - uc.start;
+    job->pos = done;
+    job->blockSize = job->bufferLen;
+    uringFree(&u);
+    free(uc.slots);
+    free(mem);
+    
+    if (err || job->rd < 0 || job->wr != job->rq) {
+        errno = err;
+        return true;
+    }
+    if (eof && job->bWrEmpty) {
+        job->wr = write(io->fdOut, io->buffer, 0);
+        io->wr++;
+    }
+    job->rd = job->wr = job->rq = 0;
+    // not finished yet if the tail was left for read/write
+    if (!eof && job->offEnd >= 0 && job->pos < job->offEnd) {
+        job->engine = ENGINE_RW;
+        return false;
+    }
+    return true;
+}
+
+// signalled by the last worker to finish, waited for with the monotonic clock
+void workersInit(pthread_mutex_t *lock, pthread_cond_t *idle) {
+    pthread_condattr_t attr;
+    pthread_mutex_init(lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(idle, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+void workerDone(pthread_mutex_t *lock, pthread_cond_t *idle, int *active) {
+    pthread_mutex_lock(lock);
+    if (__atomic_sub_fetch(active, 1, __ATOMIC_RELEASE) == 0) pthread_cond_signal(idle);
+    pthread_mutex_unlock(lock);
+}
+
+// wait for all workers to finish, but at most until the next progress update is due
+bool workersWait(pthread_mutex_t *lock, pthread_cond_t *idle, int *active) {
+    struct timespec ts;
+    bool done;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_nsec += 100000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(lock);
+    while (__atomic_load_n(active, __ATOMIC_ACQUIRE) > 0 && pthread_cond_timedwait(idle, lock, &ts) != ETIMEDOUT);
+    done = __atomic_load_n(active, __ATOMIC_ACQUIRE) == 0;
+    pthread_mutex_unlock(lock);
+    return done;
+}
+
+// remember the failure closest to the start of the range and stop all workers
+void parallelFail(struct parallelCopy *pc, off64_t off, int err, int wr, int rq) {
+    pthread_mutex_lock(&pc->lock);
+    if (off < pc->fail) {
+        pc->fail = off;
+        pc->err = err;
+        pc->failWr = wr;
+        pc->failRq = rq;
+    }
+    pthread_mutex_unlock(&pc->lock);
+    __atomic_store_n(&pc->stop, true, __ATOMIC_RELEASE);
+}
+
+void parallelStats(struct ioStatus *io, struct ioStatus *base, struct parallelCopy *pc) {
+    io->rd = base->rd + __atomic_load_n(&pc->rd, __ATOMIC_RELAXED);
+    io->wr = base->wr + __atomic_load_n(&pc->wr, __ATOMIC_RELAXED);
+    io->in = base->in + __atomic_load_n(&pc->in, __ATOMIC_RELAXED);
+    io->out = base->out + __atomic_load_n(&pc->out, __ATOMIC_RELAXED);
+}
+
+void *parallelWorker(void *arg) {
+    struct parallelCopy *pc = arg;
+    struct copyJob *job = pc->job;
+    void *buffer = allocBuffer(job->bufferLen, job->direct ? job->align : 0);
+    uint64_t k, t;
+    off64_t off, eof;
+    int len, done, n = 0;
+    
+    if (buffer == NULL) parallelFail(pc, pc->start, errno, 0, 0);
+    while (!__atomic_load_n(&pc->stop, __ATOMIC_ACQUIRE) && (k = __atomic_fetch_add(&pc->next, 1, __ATOMIC_RELAXED)) < pc->chunks) {
+        // chunks follow the read/write cycles, including an adjusted first one
+        off = pc->start + (k == 0 ? 0 : job->blockSize + (k - 1) * job->bufferLen);
+        len = k == 0 ? job->blockSize : job->bufferLen;
+        if (off + len > pc->end) len = pc->end - off;
+        for (done = 0; done < len; done += n) {
+            throttle(pc->io, 0, 1);
+            t = latStart(pc->io);
+            n = pread64(pc->io->fdIn, buffer + done, len - done, pc->inBase + off + done);
+            latEnd(pc->io, LAT_READ, t);
+            __atomic_add_fetch(&pc->rd, 1, __ATOMIC_RELAXED);
+            if (n <= 0) break;
+            __atomic_add_fetch(&pc->in, n, __ATOMIC_RELAXED);
+        }
+        if (n < 0) {
+            parallelFail(pc, off + done, errno, 0, 0);
+            break;
+        }
+        if (done < len) {
+            // end of input, keep the lowest offset
+            eof = __atomic_load_n(&pc->eof, __ATOMIC_RELAXED);
+            while (off + done < eof && !__atomic_compare_exchange_n(&pc->eof, &eof, off + done, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+        }
+        if (done == 0) continue;
+        throttle(pc->io, done, 1);
+        t = latStart(pc->io);
+        n = pwrite64(pc->io->fdOut, buffer, done, pc->outBase + (off - pc->start));
+        latEnd(pc->io, LAT_WRITE, t);
+        __atomic_add_fetch(&pc->wr, 1, __ATOMIC_RELAXED);
+        if (n != done) {
+            parallelFail(pc, off, errno, n, done);
+            break;
+        }
+        __atomic_add_fetch(&pc->out, n, __ATOMIC_RELAXED);
+        if (job->bSync && syncOut(pc->io) == -1) msgerr("sync failed");
+    }
+    free(buffer);
+    workerDone(&pc->lock, &pc->idle, &pc->active);
+    return NULL;
+}
+
+bool copyParallel(struct ioStatus *io, struct copyJob *job) {
+    struct parallelCopy pc;
+    struct ioStatus base = *io;
+    pthread_t *workers;
+    off64_t end = job->offEnd;
+    int i, flags;
+    
+    // both sides need explicit offsets
+    memset(&pc, 0, sizeof(pc));
+    pc.io = io;
+    pc.job = job;
+    pc.start = job->pos;
+    pc.inBase = lseek64(io->fdIn, 0, SEEK_CUR);
+    pc.outBase = lseek64(io->fdOut, 0, SEEK_CUR);
+    flags = fcntl(io->fdOut, F_GETFL);
+    if (end < 0 && pc.inBase != -1 && seekEnd(io->fdIn, &io->lenIn, "input") == 0) end = io->lenIn - (pc.inBase - job->pos);
+    if (pc.inBase == -1 || pc.outBase == -1 || flags == -1 || flags & O_APPEND || end < 0) {
+        if (job->bStatus) msg("parallel copy needs seekable input and output, falling back to read/write\n");
+        job->engine = ENGINE_RW;
+        return false;
+    }
+    pc.inBase -= job->pos;
+    if (!directAligned(job, &end)) return false;
+    pc.end = pc.eof = pc.fail = end;
+    pc.chunks = end <= pc.start ? 0 : end - pc.start <= job->blockSize ? 1 : 1 + (end - pc.start - job->blockSize + job->bufferLen - 1) / job->bufferLen;
+    workersInit(&pc.lock, &pc.idle);
+    
+    workers = calloc(job->threads, sizeof(pthread_t));
+    for (i = 0; i < job->threads; i++) {
+        __atomic_add_fetch(&pc.active, 1, __ATOMIC_RELAXED);
+        if ((errno = pthread_create(&workers[i], NULL, parallelWorker, &pc))) {
+            __atomic_sub_fetch(&pc.active, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    if (i == 0) {
+        if (job->bStatus) msg("failed to start threads (%s), falling back to read/write\n", strerror(errno));
+        free(workers);
+        pthread_mutex_destroy(&pc.lock);
+        pthread_cond_destroy(&pc.idle);
+        job->engine = ENGINE_RW;
+        return false;
+    }
+    
+    // aggregate progress while workers run
+    while (!workersWait(&pc.lock, &pc.idle, &pc.active)) {
+        if (io->prog >= 0 || io->statsInt) {
+            parallelStats(io, &base, &pc);
+            printProgress(io, job);
+        }
+    }
+    while (--i >= 0) pthread_join(workers[i], NULL);
+    free(workers);
+    pthread_mutex_destroy(&pc.lock);
+    pthread_cond_destroy(&pc.idle);
+    parallelStats(io, &base, &pc);
+    if (io->prog >= 0) printProgress(io, job);
+    
+    // leave file positions as read/write would
+    job->pos = pc.eof < pc.fail ? pc.eof : pc.fail;
+    lseek64(io->fdIn, pc.inBase + job->pos, SEEK_SET);
+    lseek64(io->fdOut, pc.outBase + (job->pos - pc.start), SEEK_SET);
+    if (job->posOut >= 0) job->posOut += job->pos - pc.start;
+    job->blockSize = job->bufferLen;
+    job->rd = job->wr = job->rq = 0;
+    
+    if (pc.fail < end) {
+        msg("failed at input offset %'" PRId64 "\n", pc.fail + pc.inBase);
+        if (pc.failRq == 0) job->rd = -1; else {
+            job->wr = pc.failWr;
+            job->rq = pc.failRq;
+        }
+        errno = pc.err;
+    } else if (pc.eof < end) {
+        if (job->bWrEmpty && write(io->fdOut, io->buffer, 0) != -1) io->wr++;
+    } else if (job->offEnd >= 0 && end < job->offEnd) {
+        // unaligned tail left for read/write
+        job->engine = ENGINE_RW;
+        return false;
+    }
+    return true;
+}
+
+// preferred transfer size of a file, taking the optimal I/O size of block devices
+int ioUnit(int fd) {
+    struct stat st;
+    unsigned int n = 0;
+    if (fd < 0 || fstat(fd, &st) == -1) return 0;
+    if (S_ISBLK(st.st_mode) && ioctl(fd, BLKIOOPT, &n) == 0 && n > 0) return n;
+    return st.st_blksize;
+}
+
+// start with 16 units of the larger preferred size, sizes stay multiples of it
+int autoSeed(struct autoBuffer *a, int fdIn, int fdOut, int align) {
+    int unit = ioUnit(fdIn), n = ioUnit(fdOut);
+    
+    memset(a, 0, sizeof(*a));
+    if (n > unit) unit = n;
+    if (unit < 512) unit = 512;
+    if (align > 0) unit = (unit + align - 1) / align * align;
+    a->min = unit;
+    a->max = unit > AUTO_MAX ? unit : AUTO_MAX / unit * unit;
+    a->dir = 1;
+    return unit * 16 < a->max ? unit * 16 : a->max;
+}
+
+// double or halve the buffer between cycles while throughput improves, then settle until it changes
+void adaptBuffer(struct ioStatus *io, struct copyJob *job, int bytes) {
+    struct autoBuffer *a = job->autoBuf;
+    uint64_t now = clockNs();
+    double rate, measured;
+    int len = job->bufferLen;
+    void *buf;
+    
+    a->bytes += bytes;
+    if (++a->cycles < 4 || now - a->t < 100000000ULL) return;
+    measured = rate = a->bytes * 1e9 / (now - a->t);
+    a->t = now;
+    a->bytes = a->cycles = 0;
+    // a rate limit sets the pace instead of the buffer size
+    if (io->limit != NULL && (__atomic_load_n(&io->limit->rate, __ATOMIC_RELAXED) || __atomic_load_n(&io->limit->ops, __ATOMIC_RELAXED))) {
+        a->rate = 0;
+        a->dir = 1;
+        return;
+    }
+    if (a->dir == 0) {
+        if (rate > a->rate * 0.8 && rate < a->rate * 1.2) return;
+        a->dir = rate > a->rate ? 1 : -1;
+    } else if (a->rate > 0 && rate < a->rate * 0.95) {
+        // went too far, step back and stay there, keeping the better rate
+        len = a->dir > 0 ? len / 2 : len * 2;
+        a->dir = 0;
+        rate = a->rate;
+    } else if (a->rate > 0 && rate < a->rate * 1.05) {
+        a->dir = 0;
+    }
+    a->rate = rate;
+    if (a->dir != 0) len = a->dir > 0 ? len * 2 : len / 2;
+    if (len < a->min) len = a->min;
+    if (len > a->max || (job->offEnd >= 0 && len > job->offEnd - job->pos)) len = job->bufferLen;
+    if (len == job->bufferLen) {
+        a->dir = 0;
+        return;
+    }
+    
+    if (len > job->bufferLen) {
+        if ((buf = allocBuffer(len, job->direct ? job->align : 0)) == NULL) {
+            a->dir = 0;
+            return;
+        }
+        free(io->buffer);
+        io->buffer = buf;
+        if (job->deltaBuf != NULL) {
+            if ((buf = allocBuffer(len, job->direct ? job->align : 0)) == NULL) {
+                // keep the larger main buffer, but not its size
+                a->dir = 0;
+                return;
+            }
+            free(job->deltaBuf);
+            job->deltaBuf = buf;
+        }
+    }
+    if (job->bStatus) msg("buffer size: %'d bytes (%.1f MB/s at %'d bytes)\n", len, measured / 1e6, job->bufferLen);
+    job->bufferLen = len;
+    
+    // next cycle ends on a boundary of the initial alignment
+    job->blockSize = ((a->anchor - job->pos) % len + len) % len;
+    if (job->blockSize == 0) job->blockSize = len;
+}
+
+// wait for input no longer than the deadline of the oldest unwritten byte, read at FIRST, true once it has passed
+bool coalesceDue(struct ioStatus *io, struct copyJob *job, uint64_t first) {
+    struct pollfd pfd = {io->fdIn, POLLIN, 0};
+    uint64_t now, deadline = first + job->coalesceMs * 1000000ULL;
+    int n;
+    do {
+        now = clockNs();
+        if (now >= deadline && job->coalesceMs > 0) return true;
+        n = poll(&pfd, 1, now >= deadline ? 0 : (deadline - now + 999999) / 1000000);
+    } while (n == -1 && errno == EINTR);
+    return n == 0;
+}
+
+void copyCycles(struct ioStatus *io, struct copyJob *job) {
+    int64_t num;
+    int bufferPos = 0;
+    uint64_t first = 0, skipped;
+    bool due;
+    
+    do {
+        // skip holes of sparse input without reading them
+        if (job->bSparse && bufferPos == 0 && job->pos >= job->offStart && job->pos >= job->dataEnd) {
+            num = sparseHole(io, job);
+            if (num < 0) {
+                job->dataEnd = INT64_MAX;
+            } else if (num > 0) {
+                if (holeOut(io, job, num) && zeroOut(io, job, num)) {
+                    job->wr = -1;
+                    break;
+                }
+                io->in += num;
+                io->out += num;
+                job->pos += num;
+                if (job->hashIn != NULL) hashZeros(job->hashIn, num);
+                if (job->hashOut != NULL) hashZeros(job->hashOut, num);
+                printProgress(io, job);
+                if (job->offEnd >= 0 && job->pos >= job->offEnd) {
+                    job->rd = job->wr = job->rq = 0;
+                    break;
+                }
+            }
+        }
+        
+        // hand over to the selected engine once past the skipped part of the input
+        if (job->engine != ENGINE_RW && bufferPos == 0 && job->pos >= job->offStart) {
+            if (job->engine == ENGINE_ZERO && copyZero(io, job)) break;
+            if (job->engine == ENGINE_THREAD && copyThreaded(io, job)) break;
+            if (job->engine == ENGINE_URING && copyUring(io, job)) break;
+            if (job->engine == ENGINE_PARALLEL && copyParallel(io, job)) break;
+        }
+        
+        // partial reads are coalesced until there is enough to write or the deadline has passed
+        job->rq = cycleLen(job) - bufferPos;
+        due = job->coalesce && bufferPos > 0 && coalesceDue(io, job, first);
+        if (!due) {
+            job->rd = readIn(io, job, io->buffer + bufferPos, job->rq, job->pos + job->shiftIn + bufferPos);
+            io->rd++;
+            if (job->rd < 0) break;
+            io->in += job->rd;
+            if (bufferPos == 0) first = clockNs();
+            bufferPos += job->rd;
+        }
+        if (due || (job->bFlushEach && !job->coalesce) || job->rd == 0 || job->rd == job->rq || (job->coalesce && bufferPos >= job->coalesce)) {
+            num = job->pos;
+            job->pos += bufferPos;
+            if (job->pos >= job->offStart) {
+                num = job->offStart > num ? job->offStart - num : 0;
+                job->rq = bufferPos - num;
+                if (job->rq > 0 || job->bWrEmpty) {
+                    skipped = io->skipped;
+                    job->wr = writeOut(io, job, io->buffer + num, job->rq);
+                    if (wroteOut(io, skipped, job->wr)) {
+                        if (job->bSync && job->wr != -1 && syncOut(io) == -1) msgerr("sync failed");
+                        io->wr++;
+                    }
+                } else job->wr = 0;
+                hashCopy(job, io->buffer + num, job->rq, job->wr);
+                if (job->wr < 0 || job->wr != job->rq) break;
+                io->out += job->wr;
+                if (job->behind != NULL) behindFlush(io, job, false);
+                if (job->journal != NULL) journalFlush(io, job, false);
+            } else job->wr = job->rq = 0;
+            bufferPos = 0;
+            job->blockSize = job->bufferLen;
+            if (job->autoBuf != NULL && job->wr > 0) adaptBuffer(io, job, job->wr);
+        }
+        printProgress(io, job);
+    } while (job->rd && (job->offEnd < 0 || job->pos < job->offEnd));
+    
+    // extend output over a trailing hole
+    if (job->bSparse && job->posOut > job->sizeOut && ftruncate64(io->fdOut, job->posOut) == -1 && job->wr >= 0) {
+        job->wr = -1;
+    }
+}
+
+bool copyFailed(struct copyJob *job) {
+    return job->rd < 0 || job->wr < 0 || job->wr != job->rq;
+}
+
+// length of the unaligned head before cloning is possible, -1 if it is not
+off64_t cloneHead(struct ioStatus *io) {
+    struct stat stIn, stOut;
+    off64_t inOff = lseek64(io->fdIn, 0, SEEK_CUR), outOff = lseek64(io->fdOut, 0, SEEK_CUR);
+    int flags = fcntl(io->fdOut, F_GETFL);
+    
+    if (inOff == -1 || outOff == -1 || flags == -1 || flags & O_APPEND || fstat(io->fdIn, &stIn) == -1 || fstat(io->fdOut, &stOut) == -1) return -1;
+    if (!S_ISREG(stIn.st_mode) || !S_ISREG(stOut.st_mode) || stIn.st_dev != stOut.st_dev || stOut.st_blksize < 1) return -1;
+    // both offsets have to be equally aligned
+    if ((inOff - outOff) % stOut.st_blksize) return -1;
+    return (stOut.st_blksize - inOff % stOut.st_blksize) % stOut.st_blksize;
+}
+
+// share the block aligned part of the range at the current positions between input and output
+void cloneRange(struct ioStatus *io, struct copyJob *job) {
+    struct file_clone_range fcr;
+    struct stat stIn, stOut;
+    off64_t inOff = lseek64(io->fdIn, 0, SEEK_CUR), outOff = lseek64(io->fdOut, 0, SEEK_CUR), len, n;
+    
+    if (fstat(io->fdIn, &stIn) == -1 || fstat(io->fdOut, &stOut) == -1) return;
+    len = stIn.st_size - inOff;
+    if (job->offEnd >= 0 && job->offEnd - job->pos < len) len = job->offEnd - job->pos;
+    len -= len % stOut.st_blksize;
+    for (n = 0; n < len; n += fcr.src_length) {
+        fcr.src_fd = io->fdIn;
+        fcr.src_offset = inOff + n;
+        fcr.src_length = len - n < CLONE_CHUNK ? len - n : CLONE_CHUNK;
+        fcr.dest_offset = outOff + n;
+        if (ioctl(io->fdOut, FICLONERANGE, &fcr) == -1) {
+            if (job->bStatus && n == 0) msg("cloning not possible (%s), copying instead\n", strerror(errno));
+            break;
+        }
+        io->in += fcr.src_length;
+        io->out += fcr.src_length;
+        io->cloned += fcr.src_length;
+        printProgress(io, job);
+    }
+    if (n > 0) {
+        lseek64(io->fdIn, inOff + n, SEEK_SET);
+        lseek64(io->fdOut, outOff + n, SEEK_SET);
+        job->pos += n;
+        if (job->posOut >= 0) job->posOut += n;
+        if (outOff + n > job->sizeOut) job->sizeOut = outOff + n;
+    }
+}
+
+// copy from the end of the range to its start, so data is read before it gets overwritten
+void copyBackward(struct ioStatus *io, struct copyJob *job, off64_t inOff, off64_t outOff, off64_t len) {
+    off64_t rem = len, posOut = job->posOut;
+    uint64_t t, skipped;
+    int done;
+    
+    if (job->directSet) {
+        setDirect(io->fdIn, false);
+        setDirect(io->fdOut, false);
+        job->directSet = 0;
+    }
+    job->rd = job->wr = job->rq = 0;
+    while (rem > 0) {
+        job->rq = rem < job->bufferLen ? rem : job->bufferLen;
+        rem -= job->rq;
+        for (done = 0; done < job->rq; done += job->rd) {
+            throttle(io, 0, 1);
+            t = latStart(io);
+            job->rd = pread64(io->fdIn, io->buffer + done, job->rq - done, inOff + rem + done);
+            latEnd(io, LAT_READ, t);
+            io->rd++;
+            if (job->rd <= 0) break;
+        }
+        if (job->rd < 0) return;
+        io->in += done;
+        if (done < job->rq) {
+            // input got shorter since its length was taken
+            job->rd = 0;
+            job->rq = done;
+        }
+        skipped = io->skipped;
+        if (job->bSparse || job->deltaBuf != NULL) {
+            // holes and unchanged blocks are handled as going forward, from the start of the piece
+            job->posOut = outOff + rem;
+            job->wr = lseek64(io->fdOut, job->posOut, SEEK_SET) == -1 ? -1 : writeOut(io, job, io->buffer, job->rq);
+        } else {
+            throttle(io, job->rq, 1);
+            t = latStart(io);
+            job->wr = pwrite64(io->fdOut, io->buffer, job->rq, outOff + rem);
+            latEnd(io, LAT_WRITE, t);
+        }
+        if (wroteOut(io, skipped, job->wr)) {
+            if (job->bSync && job->wr != -1 && syncOut(io) == -1) msgerr("sync failed");
+            io->wr++;
+        }
+        if (job->wr < 0 || job->wr != job->rq) return;
+        io->out += job->wr;
+        printProgress(io, job);
+        if (job->rd == 0) return;
+    }
+    
+    // a trailing hole still extends the output
+    if (job->bSparse && outOff + len > job->sizeOut) {
+        if (ftruncate64(io->fdOut, outOff + len) == -1) {
+            job->wr = -1;
+            return;
+        }
+        job->sizeOut = outOff + len;
+    }
+
+    // leave file positions as a forward copy would
+    lseek64(io->fdIn, inOff + len, SEEK_SET);
+    lseek64(io->fdOut, outOff + len, SEEK_SET);
+    job->pos += len;
+    job->posOut = posOut >= 0 ? posOut + len : posOut;
+    job->rd = job->wr = job->rq = 0;
+}
+
+// checksums of a backward copy have to read the moved data again, through the input as it is the same file
+void hashBack(struct ioStatus *io, struct copyJob *job, off64_t off, off64_t len) {
+    int n;
+    for (; len > 0; len -= n, off += n) {
+        n = pread64(io->fdIn, io->buffer, len < job->bufferLen ? len : job->bufferLen, off);
+        if (n <= 0) {
+            job->rd = -1;
+            return;
+        }
+        hashCopy(job, io->buffer, n, n);
+    }
+}
+
+// check for a copy within the same file, returns true if the range has to be copied backwards
+bool checkOverlap(struct ioStatus *io, struct copyJob *job, off64_t *inOff, off64_t *outOff, off64_t *len) {
+    struct stat stIn, stOut;
+    int flags = fcntl(io->fdOut, F_GETFL);
+    
+    if (fstat(io->fdIn, &stIn) == -1 || fstat(io->fdOut, &stOut) == -1 || stIn.st_dev != stOut.st_dev || stIn.st_ino != stOut.st_ino) return false;
+    *inOff = lseek64(io->fdIn, 0, SEEK_CUR);
+    *outOff = lseek64(io->fdOut, 0, SEEK_CUR);
+    if (*inOff == -1 || *outOff == -1 || flags == -1 || flags & O_APPEND) return false;
+    *len = stIn.st_size - *inOff;
+    if (job->offEnd >= 0 && job->offEnd - job->pos < *len) *len = job->offEnd - job->pos;
+    if (*len <= 0 || *outOff >= *inOff + *len || *inOff >= *outOff + *len) return false;
+    
+    // overlapping, forward copies need to stay in order
+    if (job->engine == ENGINE_URING || job->engine == ENGINE_PARALLEL) job->engine = ENGINE_RW;
+    job->bReflink = false;
+    return *outOff > *inOff;
+}
+
+void copyRange(struct ioStatus *io, struct copyJob *job) {
+    off64_t start = job->pos, end = job->offEnd, head, inOff, outOff, len;
+    
+    // moving data towards the end of the same file
+    if (job->pos >= job->offStart && checkOverlap(io, job, &inOff, &outOff, &len)) {
+        if (job->bStatus) {
+            msg("output overlaps input at a higher offset, copying backwards");
+            if (job->coalesce || job->behind != NULL) msg("+, %s%s%s not applied", job->coalesce ? "--coalesce" : "", job->coalesce && job->behind != NULL ? " and " : "", job->behind != NULL ? "--write-behind" : "");
+            msg("+\n");
+        }
+        // pieces are read whole from a seekable input and written in descending order
+        job->behind = NULL;
+        copyBackward(io, job, inOff, outOff, len);
+        if ((job->hashIn != NULL || job->hashOut != NULL) && !copyFailed(job)) hashBack(io, job, outOff, job->pos - start);
+        return;
+    }
+    
+    // clone what can be cloned, copy the unaligned head and tail
+    if (job->bReflink && job->pos >= job->offStart && (head = cloneHead(io)) != -1) {
+        if (end >= 0 && head > end - start) head = end - start;
+        if (head > 0) {
+            job->offEnd = start + head;
+            copyCycles(io, job);
+            job->offEnd = end;
+            if (copyFailed(job) || job->pos < start + head) return;
+        }
+        cloneRange(io, job);
+        if (end >= 0 && job->pos >= end) {
+            job->rd = job->wr = job->rq = 0;
+            return;
+        }
+        job->blockSize = job->bufferLen;
+    }
+    copyCycles(io, job);
+}
+
+void endStats(struct ioStatus *io, struct copyJob *job) {
+    if (io->prog > 0 && !job->bProgLF) fprintf(stderr, "\n");
+    if (job->bStatus && io->prog < 0) printStats(io, '\n');
+    if (io->stats != NULL) statsReport(io, true);
+}
+
+char copyError(struct copyJob *job) {
+    if (job->rd < 0) {
+        msgerr("error reading input");
+        return 1;
+    } else if (job->wr < 0) {
+        msgerr("error writing output");
+        return 1;
+    } else if (job->wr != job->rq) {
+        msg("no more space to write output (%d<%d)\n", job->wr, job->rq);
+        return 1;
+    }
+    return 0;
+}
+
+// check for exactly one integer conversion in a file name template
+char checkTemplate(char *tmpl) {
+    int n = 0;
+    char *c;
+    for (c = tmpl; *c; c++) {
+        if (*c != '%') continue;
+        if (*++c == '%') continue;
+        c += strspn(c, "-+ 0#");
+        c += strspn(c, "0123456789");
+        if (*c == '.') c += 1 + strspn(c + 1, "0123456789");
+        if (*c == '\0' || strchr("diouxX", *c) == NULL) break;
+        n++;
+    }
+    if (*c != '\0' || n != 1) {
+        msg("file name template '%s' must contain one integer conversion (like %%d) and no other\n", tmpl);
+        return 1;
+    }
+    return 0;
+}
+
+// copy every range of the index to its own file, reading the input only once
+int copySplit(struct ioStatus *io, struct copyJob *tmpl, off64_t *offIdx, char *pathTmpl, int flagsOut, bool bIgnEnd) {
+    struct copyJob job;
+    char path[PATH_MAX], hex[65];
+    int64_t n, start = 0, end;
+    off64_t pos = 0;
+    uint64_t out;
+    bool seekIn = lseek64(io->fdIn, 0, SEEK_CUR) != -1, seekIdx = lseek64(io->fdIdx, 0, SEEK_CUR) != -1;
+    
+    if (seekIn) {
+        if (seek(io->fdIn, &pos, "input") || seekEnd(io->fdIn, &io->lenIn, "input")) return EXIT_FAILURE;
+        io->total = io->lenIn;
+    }
+    if (io->prog > 1) printStats(io, tmpl->bProgLF ? '\n' : ' ');
+    for (n = 0; ; n++) {
+        end = -1;
+        if (readIdx(io, seekIdx ? offIdx : NULL, n, &end)) return EXIT_FAILURE;
+        if (end != -1 && end < start) {
+            endStats(io, tmpl);
+            msg("index entry %" PRId64 " is smaller than the previous one (%" PRId64 "<%" PRId64 ")\n", n, end, start);
+            return EXIT_FAILURE;
+        }
+        if (seekIn && start != pos) {
+            if (seek(io->fdIn, &start, "input")) return EXIT_FAILURE;
+            pos = start;
+        }
+        
+        snprintf(path, sizeof(path), pathTmpl, (int)n);
+        if ((io->fdOut = open(path, flagsOut | O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) {
+            endStats(io, tmpl);
+            msg("failed to open output file: %s: %s\n", path, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        job = *tmpl;
+        job.pos = pos;
+        job.offStart = start;
+        job.offEnd = end;
+        job.posOut = 0;
+        out = io->out;
+        if (job.hashIn != NULL) hashStart(job.hashIn, job.hashIn->alg);
+        if (job.hashOut != NULL) hashStart(job.hashOut, job.hashOut->alg);
+        if (job.behind != NULL) behindStart(io, &job);
+        copyRange(io, &job);
+        if (job.behind != NULL) behindFlush(io, &job, true);
+        if (copyFailed(&job)) {
+            endStats(io, tmpl);
+            msg("range ^%" PRId64 ": ", n);
+            copyError(&job);
+            return EXIT_FAILURE;
+        }
+        close(io->fdOut);
+        if (end >= 0 && !bIgnEnd && io->out - out != end - start) {
+            endStats(io, tmpl);
+            msg("premature end of input in range ^%" PRId64 " (%'" PRIu64 " < %'" PRId64 " bytes)\n", n, io->out - out, end - start);
+            return EXIT_FAILURE;
+        }
+        if (job.hashIn != NULL && tmpl->bStatus) {
+            hashDigest(job.hashIn, hex);
+            msg("%s: input %s: %s\n", path, hashNames[(int)job.hashIn->alg], hex);
+        }
+        if (job.hashOut != NULL && tmpl->bStatus) {
+            hashDigest(job.hashOut, hex);
+            msg("%s: output %s: %s\n", path, hashNames[(int)job.hashOut->alg], hex);
+        }
+        pos = job.pos;
+        start = end;
+        tmpl->bufferLen = tmpl->blockSize = job.bufferLen;
+        if (end == -1) break;
+    }
+    endStats(io, tmpl);
+    if (tmpl->bStatus) msg("%" PRId64 " ranges written to %s\n", n + 1, pathTmpl);
+    return EXIT_SUCCESS;
+}
+
+// one line of a range list: START END, START +LENGTH or ^N, @OFFSET and index references like on the command line
+char parseGather(struct ioStatus *io, off64_t *offIdx, char *line, off64_t *start, off64_t *end) {
+    char *a, *b, *save;
+    int64_t n;
+
+    a = strtok_r(line, " \t\r\n", &save);
+    b = strtok_r(NULL, " \t\r\n", &save);
+    if (strtok_r(NULL, " \t\r\n", &save) != NULL) {
+        msg("too many fields\n");
+        return 1;
+    }
+    *start = 0;
+    *end = -1;
+    if (a[0] == '^' || a[0] == '@') {
+        if (b != NULL) {
+            msg("a range from the index takes no END\n");
+            return 1;
+        }
+        if (a[0] == '^') {
+            if (parseNum(a + 1, &n)) return 1;
+        } else if (parseOffset(a + 1, start, io) || findIdx(io, offIdx, *start, &n)) return 1;
+        *start = 0;
+        if (n > 0 && readIdx(io, offIdx, n - 1, start)) return 1;
+        return readIdx(io, offIdx, n, end);
+    }
+    if (a[0] == ':' || a[0] == '*') {
+        if (readIdxStr(io, offIdx, a + 1, &n, start)) return 1;
+    } else if (parseOffset(a, start, io)) return 1;
+    if (b == NULL || strcmp(b, "-") == 0) return 0;
+    if (b[0] == '+') {
+        if (parseOffset(b + 1, end, io)) return 1;
+        *end += *start;
+    } else if (b[0] == ':' || b[0] == '*') {
+        if (readIdxStr(io, offIdx, b + 1, &n, end)) return 1;
+    } else if (parseOffset(b, end, io)) return 1;
+    if (*end < *start) {
+        msg("invalid range (%" PRId64 "<%" PRId64 ")\n", *end, *start);
+        return 1;
+    }
+    return 0;
+}
+
+int gatherOrder(const void *a, const void *b) {
+    const struct gatherRange *x = *(struct gatherRange **)a, *y = *(struct gatherRange **)b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    return x->line - y->line;
+}
+
+void gatherFail(struct gatherRange *r, char *what, int err) {
+    if (!r->failed) msg("range at line %d (%" PRId64 "..%" PRId64 "): %s%s%s\n", r->line, r->start, r->end, what, err ? ": " : "", err ? strerror(err) : "");
+    r->failed = true;
+}
+
+// write all of iov, at off unless the output is not seekable (-1)
+char gatherWrite(struct ioStatus *io, struct iovec *iov, int cnt, off64_t off) {
+    ssize_t n;
+    size_t len;
+    uint64_t t;
+    int i;
+
+    while (cnt > 0) {
+        for (len = 0, i = 0; i < cnt; i++) len += iov[i].iov_len;
+        throttle(io, len, 1);
+        t = latStart(io);
+        n = off == -1 ? writev(io->fdOut, iov, cnt) : pwritev64(io->fdOut, iov, cnt, off);
+        latEnd(io, LAT_WRITE, t);
+        io->wr++;
+        if (n <= 0) {
+            if (n == 0) errno = ENOSPC;
+            return 1;
+        }
+        io->out += n;
+        if (off != -1) off += n;
+        // go on after a short write
+        for (; cnt > 0 && (size_t)n >= iov->iov_len; cnt--) n -= iov++->iov_len;
+        if (cnt > 0) {
+            iov->iov_base += n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+// copy a list of ranges into one output in list order, reading them in input order
+int copyGather(struct ioStatus *io, struct copyJob *job, FILE *list, off64_t *offIdx, bool bIgnEnd) {
+    struct gatherRange *r = NULL, **order, *g;
+    struct iovec iov[IOV_MAX];
+    char *line = NULL, *p;
+    size_t lineLen = 0;
+    int n = 0, cap = 0, lineNo = 0, skipped = 0, failed = 0, i, j, q, cnt, first;
+    off64_t out = job->posOut, from, firstEnd, spanEnd, len, done, pieceStart, pieceEnd, runOut, runStart;
+    uint64_t bytes = 0, t;
+    ssize_t k;
+    bool seekOut = job->posOut != -1;
+
+    // parse the list, lines that cannot be parsed are left out
+    while (getline(&line, &lineLen, list) != -1) {
+        lineNo++;
+        p = line + strspn(line, " \t\r\n");
+        if (*p == '\0' || *p == '#') continue;
+        if (n == cap) {
+            if ((g = realloc(r, (cap ? cap * 2 : 1024) * sizeof(*r))) == NULL) {
+                msgerr("failed to allocate range list");
+                free(r);
+                free(line);
+                return EXIT_FAILURE;
+            }
+            r = g;
+            cap = cap ? cap * 2 : 1024;
+        }
+        if (parseGather(io, offIdx, p, &r[n].start, &r[n].end) || (r[n].end == -1 && seekEnd(io->fdIn, &r[n].end, "input"))) {
+            msg("line %d of range list skipped\n", lineNo);
+            skipped++;
+            continue;
+        }
+        r[n].line = lineNo;
+        r[n].failed = false;
+        n++;
+    }
+    free(line);
+    if (ferror(list)) {
+        msgerr("error reading range list");
+        return EXIT_FAILURE;
+    }
+
+    // output positions follow the list, reading follows the input when the output can be written anywhere
+    order = malloc((n > 0 ? n : 1) * sizeof(*order));
+    io->total = 0;
+    for (i = 0; i < n; i++) {
+        order[i] = &r[i];
+        r[i].out = out;
+        out += r[i].end - r[i].start;
+        io->total += r[i].end - r[i].start;
+    }
+    if (seekOut) qsort(order, n, sizeof(*order), gatherOrder);
+    if (job->bStatus) msg("ranges: %d, %'" PRId64 " bytes, %s\n", n, io->total, seekOut ? "read in input order" : "read in list order");
+    if (io->prog > 1) printStats(io, job->bProgLF ? '\n' : ' ');
+
+    for (i = 0, from = n > 0 ? order[0]->start : 0; i < n;) {
+        // one read for ranges close to each other in the input, as long as they fit in the buffer
+        g = order[i];
+        firstEnd = spanEnd = g->end - from > job->bufferLen ? from + job->bufferLen : g->end;
+        for (j = i + 1; firstEnd == g->end && j < n && j - i < IOV_MAX; j++) {
+            if (order[j]->start < from || order[j]->start - spanEnd > GATHER_GAP) break;
+            if ((order[j]->end > spanEnd ? order[j]->end : spanEnd) - from > job->bufferLen) break;
+            if (order[j]->end > spanEnd) spanEnd = order[j]->end;
+        }
+        len = spanEnd - from;
+        for (done = 0, k = 0; done < len; done += k) {
+            throttle(io, 0, 1);
+            t = latStart(io);
+            k = pread64(io->fdIn, io->buffer + done, len - done, from + done);
+            latEnd(io, LAT_READ, t);
+            io->rd++;
+            if (k <= 0) break;
+        }
+        if (k < 0) {
+            for (q = i; q < j; q++) gatherFail(order[q], "error reading input", errno);
+        }
+        bytes += done;
+
+        // pieces adjacent in the output go out in one vectored write
+        for (q = first = i, cnt = 0, runOut = runStart = 0; k >= 0 && q <= j; q++) {
+            pieceStart = pieceEnd = 0;
+            if (q < j) {
+                pieceStart = q == i ? from : order[q]->start;
+                pieceEnd = q == i ? firstEnd : order[q]->end;
+                if (pieceEnd > from + done) {
+                    // input ended within the range
+                    if (!bIgnEnd) gatherFail(order[q], "premature end of input", 0);
+                    else if (job->bStatus) msg("input ended within range at line %d\n", order[q]->line);
+                    pieceEnd = pieceStart > from + done ? pieceStart : from + done;
+                }
+                if (order[q]->failed) pieceEnd = pieceStart;
+            }
+            if (cnt > 0 && (q == j || cnt == IOV_MAX || (seekOut && order[q]->out + (pieceStart - order[q]->start) != runOut))) {
+                if (gatherWrite(io, iov, cnt, seekOut ? runStart : -1)) {
+                    for (; first < q; first++) gatherFail(order[first], "error writing output", errno);
+                }
+                cnt = 0;
+            }
+            if (q == j || pieceEnd == pieceStart) continue;
+            if (cnt == 0) {
+                first = q;
+                runStart = runOut = order[q]->out + (pieceStart - order[q]->start);
+            }
+            iov[cnt].iov_base = io->buffer + (pieceStart - from);
+            iov[cnt++].iov_len = pieceEnd - pieceStart;
+            runOut += pieceEnd - pieceStart;
+            io->in += pieceEnd - pieceStart;
+        }
+        if (job->bSync && syncOut(io) == -1) msgerr("sync failed");
+
+        // the rest of a range larger than the buffer, or the next ones
+        if (firstEnd < g->end && k > 0 && !g->failed && done == len) {
+            from = firstEnd;
+        } else if ((i = j) < n) {
+            from = order[i]->start;
+        }
+        printProgress(io, job);
+    }
+    endStats(io, job);
+
+    for (i = 0; i < n; i++) failed += r[i].failed;
+    free(order);
+    free(r);
+    if (job->bStatus) msg("%d ranges gathered, %'" PRIu64 " bytes read for them\n", n - failed, bytes);
+    if (failed || skipped) {
+        msg("%d of %d ranges failed\n", failed + skipped, n + skipped);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+// run one copy per line of a batch, keeping files, lengths and the buffer across them
+int copyBatch(struct ioStatus *io, struct copyJob *tmpl, FILE *list, off64_t *offIdx, bool bIgnEnd) {
+    struct copyJob job;
+    char *line = NULL, *p, *w, *save;
+    size_t lineLen = 0;
+    int lineNo = 0, ops = 0, failed = 0;
+    off64_t pos = lseek64(io->fdIn, 0, SEEK_CUR), posOut = tmpl->posOut, start, end, at;
+    uint64_t out;
+
+    if (io->prog > 1) printStats(io, tmpl->bProgLF ? '\n' : ' ');
+    while (getline(&line, &lineLen, list) != -1) {
+        lineNo++;
+        p = line + strspn(line, " \t\r\n");
+        if (*p == '\0' || *p == '#') continue;
+        ops++;
+
+        // output position, then the range
+        at = -1;
+        if (strncmp(p, "-w", 2) == 0 && (p[2] == ' ' || p[2] == '\t')) {
+            w = strtok_r(p + 2, " \t\r\n", &save);
+            p = save + strspn(save, " \t\r\n");
+            if (w == NULL || parseOffset(w, &at, io)) {
+                msg("line %d: bad output position\n", lineNo);
+                failed++;
+                continue;
+            }
+        }
+        if (*p == '\0') {
+            msg("line %d: no range\n", lineNo);
+            failed++;
+            continue;
+        }
+        if (parseGather(io, offIdx, p, &start, &end)) {
+            msg("line %d: bad range\n", lineNo);
+            failed++;
+            continue;
+        }
+        if ((start != pos && seek(io->fdIn, &start, "input")) || (at != -1 && at != posOut && seek(io->fdOut, &at, "output"))) {
+            // position unknown after a failed seek
+            pos = lseek64(io->fdIn, 0, SEEK_CUR);
+            failed++;
+            continue;
+        }
+        if (at != -1) posOut = at;
+
+        job = *tmpl;
+        job.pos = job.offStart = start;
+        job.offEnd = end;
+        job.posOut = posOut;
+        out = io->out;
+        copyRange(io, &job);
+        tmpl->bufferLen = tmpl->blockSize = job.bufferLen;
+        // keep the progress of each operation on its own line
+        if (io->prog == 1 && !tmpl->bProgLF) {
+            fprintf(stderr, "\n");
+            io->prog = 0;
+        }
+        if (copyFailed(&job)) {
+            msg("line %d: ", lineNo);
+            copyError(&job);
+            pos = lseek64(io->fdIn, 0, SEEK_CUR);
+            posOut = posOut == -1 ? -1 : lseek64(io->fdOut, 0, SEEK_CUR);
+            failed++;
+            continue;
+        }
+        pos = job.pos;
+        posOut = job.posOut;
+        if (io->lenOut != -1 && posOut > io->lenOut) io->lenOut = posOut;
+        if (end >= 0 && io->out - out != end - start) {
+            if (!bIgnEnd) {
+                msg("line %d: premature end of input (%'" PRIu64 " < %'" PRId64 " bytes)\n", lineNo, io->out - out, end - start);
+                failed++;
+                continue;
+            }
+            if (tmpl->bStatus) msg("line %d: input ended at offset %'" PRId64 "\n", lineNo, pos);
+        }
+        if (tmpl->bStatus) msg("line %d: %'" PRIu64 " bytes from %" PRId64 "\n", lineNo, io->out - out, start);
+    }
+    free(line);
+    if (ferror(list)) msgerr("error reading batch");
+    endStats(io, tmpl);
+    if (tmpl->bStatus) msg("%d of %d operations done\n", ops - failed, ops);
+    if (failed) {
+        msg("%d of %d operations failed\n", failed, ops);
+        return EXIT_FAILURE;
+    }
+    return ferror(list) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// set [a, b) of the map to STATUS, merging it with neighbours of the same status
+void rescueMark(struct rescue *rc, off64_t a, off64_t b, char status) {
+    struct rescueExtent p[5], *map;
+    int lo, hi, mid, i, n, k = 0;
+
+    pthread_mutex_lock(&rc->lock);
+    // extents lo to hi overlap [a, b), the ones next to them may merge with what replaces them
+    for (lo = 0, hi = rc->n; lo < hi; ) {
+        mid = (lo + hi) / 2;
+        if (rc->map[mid].end <= a) lo = mid + 1; else hi = mid;
+    }
+    for (hi = lo; hi < rc->n && rc->map[hi].start < b; hi++);
+    if (lo > 0) p[k++] = rc->map[lo - 1];
+    if (lo < hi && rc->map[lo].start < a) p[k++] = (struct rescueExtent){rc->map[lo].start, a, rc->map[lo].status};
+    p[k++] = (struct rescueExtent){a, b, status};
+    if (lo < hi && rc->map[hi - 1].end > b) p[k++] = (struct rescueExtent){b, rc->map[hi - 1].end, rc->map[hi - 1].status};
+    if (hi < rc->n) p[k++] = rc->map[hi];
+    if (lo > 0) lo--;
+    if (hi < rc->n) hi++;
+    for (i = n = 1; i < k; i++) {
+        if (p[n - 1].status == p[i].status) p[n - 1].end = p[i].end; else p[n++] = p[i];
+    }
+
+    if (rc->n + n > rc->cap) {
+        // keep the map as it is, so the one last saved still matches the output, and stop
+        if ((map = realloc(rc->map, (rc->cap * 2 + n) * sizeof(struct rescueExtent))) == NULL) {
+            if (a < rc->fail) {
+                rc->fail = a;
+                rc->err = ENOMEM;
+                rc->failWr = false;
+            }
+            pthread_mutex_unlock(&rc->lock);
+            __atomic_store_n(&rc->stop, true, __ATOMIC_RELEASE);
+            return;
+        }
+        rc->map = map;
+        rc->cap = rc->cap * 2 + n;
+    }
+    memmove(&rc->map[lo + n], &rc->map[hi], (rc->n - hi) * sizeof(struct rescueExtent));
+    memcpy(&rc->map[lo], p, n * sizeof(struct rescueExtent));
+    rc->n += n - (hi - lo);
+    pthread_mutex_unlock(&rc->lock);
+}
+
+// make output durable, then replace the map, when it is due or at the end
+void rescueSave(struct rescue *rc, bool last) {
+    FILE *f;
+    uint64_t t = clockNs();
+    int i;
+
+    pthread_mutex_lock(&rc->lock);
+    if (!last && t < rc->tSave) {
+        pthread_mutex_unlock(&rc->lock);
+        return;
+    }
+    rc->tSave = t + RESCUE_SAVE;
+    t = latStart(rc->io);
+    i = fdatasync(rc->io->fdOut);
+    latEnd(rc->io, LAT_SYNC, t);
+    if (i == -1 && errno != EINVAL) {
+        msgerr("failed to sync output for rescue map");
+        pthread_mutex_unlock(&rc->lock);
+        return;
+    }
+    if ((f = fopen(rc->tmp, "w")) == NULL) {
+        msg("failed to open rescue map: %s: %s\n", rc->tmp, strerror(errno));
+        pthread_mutex_unlock(&rc->lock);
+        return;
+    }
+    fprintf(f, "# bytecopy rescue map, + read, - unreadable, ? not tried\nrange %" PRId64 " %" PRId64 "\noutput %" PRId64 "\n", rc->start, rc->end, rc->outBase);
+    for (i = 0; i < rc->n; i++) fprintf(f, "%" PRId64 " %" PRId64 " %c\n", rc->map[i].start, rc->map[i].end, rc->map[i].status);
+    if (fflush(f) == EOF || fdatasync(fileno(f)) == -1) {
+        msg("failed to write rescue map: %s: %s\n", rc->tmp, strerror(errno));
+        fclose(f);
+    } else if (fclose(f) == EOF || rename(rc->tmp, rc->path) == -1) {
+        msg("failed to replace rescue map: %s: %s\n", rc->path, strerror(errno));
+    }
+    pthread_mutex_unlock(&rc->lock);
+}
+
+// map of an earlier pass over the same range, -1 if there is none
+int rescueLoad(struct rescue *rc) {
+    FILE *f = fopen(rc->path, "r");
+    char *line = NULL, status;
+    size_t lineLen = 0;
+    int64_t start, end, out = -1;
+    off64_t next = rc->start;
+    bool bRange = false, bad = false;
+
+    if (f == NULL) {
+        if (errno == ENOENT) return -1;
+        msg("failed to open rescue map: %s: %s\n", rc->path, strerror(errno));
+        return 1;
+    }
+    while (!bad && getline(&line, &lineLen, f) != -1) {
+        if (line[strspn(line, " \t\r\n")] == '\0' || line[0] == '#') continue;
+        if (sscanf(line, "range %" SCNd64 " %" SCNd64, &start, &end) == 2) {
+            if (start != rc->start || end != rc->end) {
+                msg("rescue map is for range %" PRId64 "..%" PRId64 ", not %" PRId64 "..%" PRId64 ": %s\n", start, end, rc->start, rc->end, rc->path);
+                fclose(f);
+                free(line);
+                return 1;
+            }
+            bRange = true;
+        } else if (sscanf(line, "output %" SCNd64, &out) == 1) {
+            bad = out < 0;
+        } else if (sscanf(line, "%" SCNd64 " %" SCNd64 " %c", &start, &end, &status) == 3 && start == next && end > start && end <= rc->end && strchr("+-?", status) != NULL) {
+            rescueMark(rc, start, end, status);
+            next = end;
+        } else bad = true;
+    }
+    fclose(f);
+    free(line);
+    if (bad || !bRange || out == -1 || next != rc->end) {
+        msg("rescue map is damaged: %s\n", rc->path);
+        return 1;
+    }
+    if (rc->bOutSet && out != rc->outBase) {
+        msg("rescue map is for output offset %'" PRId64 ", not %'" PRId64 ": %s\n", out, rc->outBase, rc->path);
+        return 1;
+    }
+    rc->outBase = out;
+    return 0;
+}
+
+void rescueFail(struct rescue *rc, off64_t off, int err, bool wr) {
+    pthread_mutex_lock(&rc->lock);
+    if (off < rc->fail) {
+        rc->fail = off;
+        rc->err = err;
+        rc->failWr = wr;
+    }
+    pthread_mutex_unlock(&rc->lock);
+    __atomic_store_n(&rc->stop, true, __ATOMIC_RELEASE);
+}
+
+// write what was read, or zeros for what could not be, and record it in the map
+void rescueWrite(struct rescue *rc, void *buf, off64_t off, int len, char status) {
+    uint64_t t;
+    ssize_t n;
+
+    throttle(rc->io, len, 1);
+    t = latStart(rc->io);
+    n = pwrite64(rc->io->fdOut, buf, len, rc->outBase + (off - rc->start));
+    latEnd(rc->io, LAT_WRITE, t);
+    __atomic_add_fetch(&rc->wr, 1, __ATOMIC_RELAXED);
+    if (n != len) {
+        rescueFail(rc, off, n == -1 ? errno : ENOSPC, true);
+        return;
+    }
+    __atomic_add_fetch(&rc->out, n, __ATOMIC_RELAXED);
+    if (status == '-') __atomic_add_fetch(&rc->bad, n, __ATOMIC_RELAXED);
+    rescueMark(rc, off, off + len, status);
+}
+
+// copy [a, b) in reads of SIZE, a read that fails is retried with half the size down to a sector, sectors that still fail are zero filled
+void rescueSpan(struct rescue *rc, void *buf, off64_t a, off64_t b, int size) {
+    off64_t p = rc->bReverse ? b : a, q, eof;
+    int len;
+    uint64_t t;
+    ssize_t n;
+
+    while ((rc->bReverse ? p > a : p < b) && !__atomic_load_n(&rc->stop, __ATOMIC_ACQUIRE)) {
+        // next piece, backwards from the end when reversed
+        len = rc->bReverse ? (p - a < size ? p - a : size) : (b - p < size ? b - p : size);
+        q = rc->bReverse ? p - len : p;
+        p = rc->bReverse ? q : q + len;
+        throttle(rc->io, 0, 1);
+        t = latStart(rc->io);
+        n = pread64(rc->io->fdIn, buf, len, rc->inBase + q);
+        latEnd(rc->io, LAT_READ, t);
+        __atomic_add_fetch(&rc->rd, 1, __ATOMIC_RELAXED);
+        if (n > 0) {
+            __atomic_add_fetch(&rc->in, n, __ATOMIC_RELAXED);
+            rescueWrite(rc, buf, q, n, '+');
+            if (n < len) rescueSpan(rc, buf, q + n, q + len, size);
+        } else if (n == 0) {
+            // end of input, keep the lowest offset
+            eof = __atomic_load_n(&rc->eof, __ATOMIC_RELAXED);
+            while (q < eof && !__atomic_compare_exchange_n(&rc->eof, &eof, q, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+            if (!rc->bReverse) return;
+        } else if (errno != EIO && errno != ENODATA && errno != EREMOTEIO) {
+            rescueFail(rc, q, errno, false);
+        } else if (len > rc->sector) {
+            rescueSpan(rc, buf, q, q + len, ((len / 2 + rc->sector - 1) / rc->sector) * rc->sector);
+        } else {
+            rescueWrite(rc, rc->zeros, q, len, '-');
+        }
+    }
+}
+
+// chunk K of the areas to read, counted over all of them in order
+void rescueChunk(struct rescue *rc, uint64_t k, off64_t *a, off64_t *b) {
+    int lo = 0, hi = rc->nTodo - 1, mid;
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (rc->todo[mid].first <= k) lo = mid; else hi = mid - 1;
+    }
+    *a = rc->todo[lo].start + (k - rc->todo[lo].first) * rc->job->bufferLen;
+    *b = *a + rc->job->bufferLen < rc->todo[lo].end ? *a + rc->job->bufferLen : rc->todo[lo].end;
+}
+
+void *rescueWorker(void *arg) {
+    struct rescue *rc = arg;
+    void *buffer = allocBuffer(rc->job->bufferLen, 0);
+    off64_t a, b;
+    uint64_t k;
+
+    if (buffer == NULL) rescueFail(rc, rc->start, errno, false);
+    while (!__atomic_load_n(&rc->stop, __ATOMIC_ACQUIRE) && (k = __atomic_fetch_add(&rc->next, 1, __ATOMIC_RELAXED)) < rc->chunks) {
+        rescueChunk(rc, rc->bReverse ? rc->chunks - 1 - k : k, &a, &b);
+        rescueSpan(rc, buffer, a, b, rc->job->bufferLen);
+        rescueSave(rc, false);
+    }
+    free(buffer);
+    workerDone(&rc->lock, &rc->idle, &rc->active);
+    return NULL;
+}
+
+void rescueStats(struct ioStatus *io, struct rescue *rc) {
+    io->rd = __atomic_load_n(&rc->rd, __ATOMIC_RELAXED);
+    io->wr = __atomic_load_n(&rc->wr, __ATOMIC_RELAXED);
+    io->in = __atomic_load_n(&rc->in, __ATOMIC_RELAXED);
+    io->out = __atomic_load_n(&rc->out, __ATOMIC_RELAXED);
+}
+
+// copy around read errors, reading only what the map of earlier passes has not read yet
+int copyRescue(struct ioStatus *io, struct copyJob *job, struct rescue *rc, bool bIgnEnd) {
+    pthread_t *workers;
+    off64_t bad = 0, left = 0;
+    int i, found, areas = 0;
+
+    rc->io = io;
+    rc->job = job;
+    rc->eof = rc->fail = rc->end;
+    workersInit(&rc->lock, &rc->idle);
+    if (rc->end > rc->start) rescueMark(rc, rc->start, rc->end, '?');
+    if ((found = rescueLoad(rc)) == 1) return EXIT_FAILURE;
+
+    // areas not read yet, split into chunks of the buffer size
+    rc->todo = calloc(rc->n + 1, sizeof(struct rescueArea));
+    for (i = 0; i < rc->n; i++) {
+        if (rc->map[i].status == '+') continue;
+        rc->todo[rc->nTodo] = (struct rescueArea){rc->map[i].start, rc->map[i].end, rc->chunks};
+        rc->chunks += (rc->map[i].end - rc->map[i].start + job->bufferLen - 1) / job->bufferLen;
+        io->total += rc->map[i].end - rc->map[i].start;
+        rc->nTodo++;
+    }
+    if ((rc->zeros = calloc(1, rc->sector)) == NULL) {
+        msgerr("failed to allocate buffer");
+        return EXIT_FAILURE;
+    }
+    if (job->bStatus) {
+        msg("rescue map: %s (%s), %'" PRId64 " bytes to read in %d areas%s\n", rc->path, found == -1 ? "new" : "earlier pass", io->total, rc->nTodo, rc->bReverse ? ", in reverse" : "");
+        msg("retrying failed reads down to %d bytes\n", rc->sector);
+    }
+
+    workers = calloc(job->threads, sizeof(pthread_t));
+    for (i = 0; i < job->threads; i++) {
+        __atomic_add_fetch(&rc->active, 1, __ATOMIC_RELAXED);
+        if ((errno = pthread_create(&workers[i], NULL, rescueWorker, rc))) {
+            __atomic_sub_fetch(&rc->active, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    if (i == 0) {
+        msg("failed to start threads: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    while (!workersWait(&rc->lock, &rc->idle, &rc->active)) {
+        if (io->prog >= 0 || io->statsInt) {
+            rescueStats(io, rc);
+            printProgress(io, job);
+        }
+    }
+    while (--i >= 0) pthread_join(workers[i], NULL);
+    free(workers);
+    rescueStats(io, rc);
+    if (io->prog >= 0) printProgress(io, job);
+    rescueSave(rc, true);
+    endStats(io, job);
+
+    if (rc->fail < rc->end) {
+        msg("failed %s at input offset %'" PRId64 ": %s\n", rc->failWr ? "writing output" : "reading input", rc->fail, strerror(rc->err));
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < rc->n; i++) {
+        if (rc->map[i].status == '-') {
+            bad += rc->map[i].end - rc->map[i].start;
+            areas++;
+        } else if (rc->map[i].status == '?' && rc->map[i].start < rc->eof) {
+            left += rc->map[i].end - rc->map[i].start;
+        }
+    }
+    if (job->bStatus) msg("%'" PRIu64 " bytes read, %'" PRIu64 " bytes unreadable in this pass\n", io->in, rc->bad);
+    if (rc->eof < rc->end) {
+        if (!bIgnEnd) {
+            msg("premature end of input at offset %'" PRId64 "\n", rc->eof);
+            return EXIT_FAILURE;
+        }
+        if (job->bStatus) msg("input ended at offset %'" PRId64 "\n", rc->eof);
+    }
+    if (bad || left) {
+        msg("%'" PRId64 " bytes in %d areas unreadable, filled with zeros", bad, areas);
+        if (left) fprintf(stderr, ", %'" PRId64 " bytes not tried", left);
+        fprintf(stderr, "\n");
+        return EXIT_FAILURE;
+    }
+    if (job->bStatus) msg("all of the range has been read\n");
+    return EXIT_SUCCESS;
+}
+
+// write the pattern over LEN bytes at the current output position, DONE bytes of the range are written already
+char fillWrite(struct ioStatus *io, struct copyJob *job, struct fill *fl, void *buf, int bufLen, off64_t done, off64_t len) {
+    struct iovec iov[FILL_IOV];
+    off64_t left;
+    ssize_t n;
+    uint64_t t;
+    int i, skip;
+
+    for (; len > 0; len -= n, done += n) {
+        // the buffer holds whole patterns, the first vector picks up where the last write ended
+        skip = done % fl->len;
+        for (i = 0, left = len; i < FILL_IOV && left > 0; i++) {
+            iov[i].iov_base = buf + (i == 0 ? skip : 0);
+            iov[i].iov_len = bufLen - (i == 0 ? skip : 0);
+            if (iov[i].iov_len > left) iov[i].iov_len = left;
+            left -= iov[i].iov_len;
+        }
+        throttle(io, len - left, 1);
+        t = latStart(io);
+        n = writev(io->fdOut, iov, i);
+        latEnd(io, LAT_WRITE, t);
+        io->wr++;
+        if (n <= 0) {
+            if (n == 0) errno = ENOSPC;
+            return 1;
+        }
+        io->in += n;
+        io->out += n;
+        if (job->bSync && syncOut(io) == -1) msgerr("sync failed");
+        printProgress(io, job);
+    }
+    return 0;
+}
+
+// zero or discard LEN bytes at output offset OFF by the file system or device, how much was done or -1 on failure
+off64_t fillOffload(struct ioStatus *io, struct copyJob *job, struct fill *fl, struct stat *st, off64_t off, off64_t len) {
+    static char *names[] = {"fallocate", "BLKZEROOUT", "BLKDISCARD"};
+    int method = S_ISBLK(st->st_mode) ? (fl->mode == FILL_ZERO ? 1 : 2) : 0, r;
+    off64_t done, n;
+    uint64_t range[2], t;
+
+    // devices only take whole sectors
+    if (method) len -= len % blockAlign(io->fdOut);
+    for (done = 0; done < len; done += n) {
+        n = len - done < FILL_CHUNK ? len - done : FILL_CHUNK;
+        throttle(io, n, 1);
+        t = latStart(io);
+        if (method == 0) {
+            r = fallocate64(io->fdOut, fl->mode == FILL_ZERO ? FALLOC_FL_ZERO_RANGE : FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, off + done, n);
+        } else {
+            range[0] = off + done;
+            range[1] = n;
+            r = ioctl(io->fdOut, method == 1 ? BLKZEROOUT : BLKDISCARD, range);
+        }
+        latEnd(io, LAT_WRITE, t);
+        io->wr++;
+        // not on the progress line of the head
+        if (done == 0 && io->prog == 1 && !job->bProgLF) {
+            fprintf(stderr, "\n");
+            io->prog = 0;
+        }
+        if (r == -1) {
+            if (done > 0 || (errno != EOPNOTSUPP && errno != ENOTTY && errno != EINVAL)) return -1;
+            if (job->bStatus) msg("%s not possible (%s), writing zeros instead\n", names[method], strerror(errno));
+            return 0;
+        }
+        if (done == 0 && job->bStatus) msg("%s by %s\n", fl->mode == FILL_ZERO ? "zeroing" : "discarding", names[method]);
+        io->in += n;
+        io->out += n;
+        printProgress(io, job);
+    }
+    // punched holes leave the size as it was
+    if (method == 0 && fl->mode == FILL_DISCARD && off + done > st->st_size && ftruncate64(io->fdOut, off + done) == -1) return -1;
+    if (lseek64(io->fdOut, off + done, SEEK_SET) == -1) return -1;
+    return done;
+}
+
+// fill LEN bytes of output with the pattern, zeroing and discarding are left to the file system or device where they can be
+int copyFill(struct ioStatus *io, struct copyJob *job, struct fill *fl, off64_t len) {
+    struct stat st;
+    off64_t off = lseek64(io->fdOut, 0, SEEK_CUR), done = 0, head = 0, n = 0;
+    int i, bufLen, flags = fcntl(io->fdOut, F_GETFL);
+    bool offload = false;
+    char err = 0;
+    void *buf;
+
+    io->total = len;
+    if (fl->mode != FILL_PATTERN && off != -1 && flags != -1 && !(flags & O_APPEND) && fstat(io->fdOut, &st) == 0) {
+        offload = S_ISREG(st.st_mode) || S_ISBLK(st.st_mode);
+        // the unaligned head is written on devices
+        if (S_ISBLK(st.st_mode)) {
+            i = blockAlign(io->fdOut);
+            head = (i - off % i) % i;
+            if (head > len) head = len;
+        }
+    }
+    if (fl->len == 0) fl->len = 1;
+    bufLen = job->bufferLen < fl->len ? fl->len : job->bufferLen - job->bufferLen % fl->len;
+    if ((buf = allocBuffer(bufLen, 0)) == NULL) {
+        msgerr("failed to allocate buffer");
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < bufLen; i += fl->len) memcpy(buf + i, fl->pattern, fl->len);
+
+    if (offload) {
+        err = fillWrite(io, job, fl, buf, bufLen, 0, head);
+        if (!err && (n = fillOffload(io, job, fl, &st, off + head, len - head)) == -1) err = 1;
+        done = head + n;
+    }
+    if (!err) err = fillWrite(io, job, fl, buf, bufLen, done, len - done);
+    flags = errno;
+    free(buf);
+    endStats(io, job);
+    if (err) {
+        msg("failed to fill output after %'" PRIu64 " bytes: %s\n", io->out, strerror(flags));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+bool strIsChar(char *s, char c) {
+    return s[0] == c && s[1] == '\0';
+}
+
+int errArg(int n) {
+    msg("illegal argument #%d\n", n);
+    return EXIT_FAILURE;
+}
+
+// truncate and position one of several outputs, like -T and -w do for a single one
+char teePrepare(struct ioStatus *io, struct teeOut *o, bool bStatus) {
+    off64_t off;
+
+    // offsets relative to the end refer to this output
+    io->fdOut = o->fd;
+    io->lenOut = -1;
+    if (o->truncate.idx != 0) {
+        if (parseOffset(o->truncate.str, &off, io)) return errArg(o->truncate.idx);
+        if (ftruncate64(o->fd, off) == -1) {
+            msg("failed to truncate %s to %'" PRId64 " bytes: %s\n", o->name, off, strerror(errno));
+            return 1;
+        }
+        if (bStatus) msg("%s truncated to %'" PRId64 " bytes\n", o->name, off);
+        io->lenOut = off;
+    }
+    if (o->seek.idx > 0) {
+        if (parseOffset(o->seek.str, &off, io)) return errArg(o->seek.idx);
+        if (seek(o->fd, &off, o->name)) return 1;
+    } else if (o->seek.idx == 0 && o->path != NULL && !(o->flags & O_TRUNC)) {
+        lseek64(o->fd, 0, SEEK_END);
+    }
+    return 0;
+}
+
+// write every buffer to one output, after a failure only release them so the other outputs go on
+void *teeWriter(void *arg) {
+    struct teeOut *o = arg;
+    struct tee *tee = o->tee;
+    struct teeSlot *slot;
+    uint64_t t;
+    int n;
+
+    for (;;) {
+        pthread_mutex_lock(&tee->lock);
+        while (o->seq == tee->filled && !tee->done) pthread_cond_wait(&tee->cond, &tee->lock);
+        if (o->seq == tee->filled) {
+            pthread_mutex_unlock(&tee->lock);
+            // signal the end of input like a single output would (-e)
+            if (tee->eof && tee->job->bWrEmpty && !o->failed) {
+                if (write(o->fd, tee->slots[0].buffer, 0) == -1) {
+                    msg("%s: error writing output: %s\n", o->name, strerror(errno));
+                    __atomic_store_n(&o->failed, true, __ATOMIC_RELAXED);
+                }
+                __atomic_add_fetch(&o->wr, 1, __ATOMIC_RELAXED);
+            }
+            break;
+        }
+        pthread_mutex_unlock(&tee->lock);
+
+        slot = &tee->slots[o->seq % tee->nSlots];
+        if (!o->failed && slot->len > 0) {
+            throttle(tee->io, 0, 1);
+            t = latStart(tee->io);
+            n = write(o->fd, slot->buffer, slot->len);
+            latEnd(tee->io, LAT_WRITE, t);
+            __atomic_add_fetch(&o->wr, 1, __ATOMIC_RELAXED);
+            if (n != slot->len) {
+                if (n < 0) msg("%s: error writing output: %s\n", o->name, strerror(errno));
+                else msg("%s: no more space to write output (%d<%d)\n", o->name, n, slot->len);
+                __atomic_store_n(&o->failed, true, __ATOMIC_RELAXED);
+            } else {
+                __atomic_add_fetch(&o->out, n, __ATOMIC_RELAXED);
+                if (tee->job->bSync) {
+                    t = latStart(tee->io);
+                    if (fsync(o->fd) == -1) msg("%s: sync failed: %s\n", o->name, strerror(errno));
+                    latEnd(tee->io, LAT_SYNC, t);
+                }
+            }
+        }
+
+        pthread_mutex_lock(&tee->lock);
+        o->seq++;
+        if (--slot->pending == 0) pthread_cond_broadcast(&tee->cond);
+        pthread_mutex_unlock(&tee->lock);
+    }
+    return NULL;
 }
 
-bool strIsChar(char *s, char c) {
-    return s[0] == c && s[1] == '\0';
+// output progress is that of the slowest output still working
+void teeStats(struct ioStatus *io, struct ioStatus *base, struct tee *tee) {
+    uint64_t out = UINT64_MAX, wr = 0, n;
+    int i;
+    for (i = 0; i < tee->nOuts; i++) {
+        wr += __atomic_load_n(&tee->outs[i].wr, __ATOMIC_RELAXED);
+        n = __atomic_load_n(&tee->outs[i].out, __ATOMIC_RELAXED);
+        if (!__atomic_load_n(&tee->outs[i].failed, __ATOMIC_RELAXED) && n < out) out = n;
+    }
+    io->wr = base->wr + wr;
+    io->out = base->out + (out == UINT64_MAX ? 0 : out);
 }
 
-int errArg(int n) {
-    msg("illegal argument #%d\n", n);
-    return EXIT_FAILURE;
+// with -n, each progress report is followed by the bytes written to every output
+void teeProgress(struct ioStatus *io, struct copyJob *job, struct tee *tee) {
+    int i;
+    printProgress(io, job);
+    if (io->prog < 0 || !job->bProgLF) return;
+    msg("outputs: ");
+    for (i = 0; i < tee->nOuts; i++) {
+        fprintf(stderr, "%s%s %'" PRIu64 "%s", i ? ", " : "", tee->outs[i].name, __atomic_load_n(&tee->outs[i].out, __ATOMIC_RELAXED), __atomic_load_n(&tee->outs[i].failed, __ATOMIC_RELAXED) ? " (failed)" : "");
+    }
+    fprintf(stderr, "\n");
+}
+
+// read each buffer once and have it written to all outputs by a thread per output
+int copyTee(struct ioStatus *io, struct copyJob *job, struct teeOut *outs, int nOuts, bool bIgnEnd) {
+    struct tee tee = {io, job, NULL, outs, nOuts, job->buffers};
+    struct ioStatus base = *io;
+    struct teeSlot *slot;
+    int i, n, rq, failed = 0, started;
+
+    pthread_mutex_init(&tee.lock, NULL);
+    pthread_cond_init(&tee.cond, NULL);
+    tee.slots = calloc(tee.nSlots, sizeof(struct teeSlot));
+    tee.slots[0].buffer = io->buffer;
+    for (i = 1; i < tee.nSlots; i++) {
+        if ((tee.slots[i].buffer = allocBuffer(job->bufferLen, 0)) == NULL) {
+            msgerr("failed to allocate buffer");
+            return EXIT_FAILURE;
+        }
+    }
+    for (started = 0; started < nOuts; started++) {
+        outs[started].tee = &tee;
+        if ((errno = pthread_create(&outs[started].thread, NULL, teeWriter, &outs[started]))) {
+            msg("failed to start writer thread: %s\n", strerror(errno));
+            break;
+        }
+    }
+
+    if (io->prog > 1) printStats(io, job->bProgLF ? '\n' : ' ');
+    while (started == nOuts) {
+        // wait for all outputs to be done with the buffer, the slowest one bounds how far the others get ahead
+        slot = &tee.slots[tee.filled % tee.nSlots];
+        pthread_mutex_lock(&tee.lock);
+        while (slot->pending > 0) pthread_cond_wait(&tee.cond, &tee.lock);
+        pthread_mutex_unlock(&tee.lock);
+        for (i = 0; i < nOuts && __atomic_load_n(&outs[i].failed, __ATOMIC_RELAXED); i++);
+        if (i == nOuts) break;
+
+        // skipped input is read into the same buffer and dropped
+        rq = job->pos < job->offStart ? (job->offStart - job->pos < job->bufferLen ? job->offStart - job->pos : job->bufferLen) : cycleLen(job);
+        slot->len = 0;
+        do {
+            n = readIn(io, job, slot->buffer + slot->len, rq - slot->len, job->pos + slot->len);
+            io->rd++;
+            if (n > 0) slot->len += n;
+        } while (n > 0 && !job->bFlushEach && slot->len < rq);
+        job->rd = n < 0 ? -1 : slot->len;
+        if (slot->len == 0) {
+            tee.eof = n == 0;
+            break;
+        }
+        io->in += slot->len;
+        throttle(io, slot->len, 0);
+        if (job->pos < job->offStart) {
+            job->pos += slot->len;
+            continue;
+        }
+        job->pos += slot->len;
+        job->blockSize = job->bufferLen;
+
+        pthread_mutex_lock(&tee.lock);
+        slot->pending = nOuts;
+        tee.filled++;
+        pthread_cond_broadcast(&tee.cond);
+        pthread_mutex_unlock(&tee.lock);
+
+        teeStats(io, &base, &tee);
+        teeProgress(io, job, &tee);
+        if (n < 0 || (job->offEnd >= 0 && job->pos >= job->offEnd)) break;
+    }
+
+    // let the writers finish what was read
+    pthread_mutex_lock(&tee.lock);
+    tee.done = true;
+    pthread_cond_broadcast(&tee.cond);
+    pthread_mutex_unlock(&tee.lock);
+    for (i = 0; i < started; i++) pthread_join(outs[i].thread, NULL);
+    for (i = 1; i < tee.nSlots; i++) free(tee.slots[i].buffer);
+    free(tee.slots);
+    pthread_cond_destroy(&tee.cond);
+    pthread_mutex_destroy(&tee.lock);
+    teeStats(io, &base, &tee);
+    if (io->prog >= 0) printProgress(io, job);
+    endStats(io, job);
+
+    if (started < nOuts) return EXIT_FAILURE;
+    if (job->rd < 0) {
+        msgerr("error reading input");
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < nOuts; i++) {
+        if (outs[i].failed) failed++;
+        if (job->bStatus) msg("%s: %'" PRIu64 " bytes in %'" PRIu64 " writes%s\n", outs[i].name, outs[i].out, outs[i].wr, outs[i].failed ? ", failed" : "");
+        if (outs[i].path != NULL) close(outs[i].fd);
+    }
+    if (failed) {
+        msg("%d of %d outputs failed\n", failed, nOuts);
+        return EXIT_FAILURE;
+    }
+    if (job->offEnd >= 0 && job->pos < job->offEnd) {
+        if (!bIgnEnd) {
+            msg("premature end of input (%'" PRId64 " < %'" PRId64 " bytes)\n", job->pos - job->offStart, job->offEnd - job->offStart);
+            return EXIT_FAILURE;
+        }
+        if (job->bStatus) msg("input ended at offset %'" PRId64 "\n", job->pos);
+    }
+    return EXIT_SUCCESS;
 }
 
 void printUsage() {
@@ -204,15 +3838,16 @@ void printUsage() {
         "or for LENGTH or till the end of input, to output.\n"
         "\n"
         "    -a OFFSET   adjust buffer size for initial cycle by OFFSET (number or r: input, w: output)\n"
-        "    -b SIZE     buffer up to SIZE bytes per read/write cycle (default: 512K)\n"
+        "    -b SIZE     buffer up to SIZE bytes per read/write cycle (default: 512K, auto: adapt to device and throughput)\n"
         "    -B          force buffering, do not write after partial read\n"
         "    -e          write final buffer even if empty\n"
         "    -E          do not consider premature end of input an error\n"
         "    -h          print this help and exit\n"
         "    -i FILE     open FILE for input, instead of reading from standard input (overrides -I)\n"
         "    -I FD       read from the specified file descriptor (default: standard input)\n"
+        "    -j N        copy N buffers at a time using as many threads (needs seekable input and output)\n"
         "    -n          print each progress report on a new line\n"
-        "    -o FILE     open FILE for output, instead of writing to standard output (overrides -O)\n"
+        "    -o FILE     open FILE for output, instead of writing to standard output (may be repeated, like -O)\n"
         "    -O FD       write to the specified file descriptor (default: standard output)\n"
         "    -p          print progress but no status messages (implies -Q, overrides -q)\n"
         "    -P POS      use POS as offset for reading index values\n"
@@ -231,6 +3866,36 @@ void printUsage() {
         "    -Y          use fully synchronized write mode (only works with -o)\n"
         "    -z          don't seek to end of output file (alias for -w '-', default when not using -o)\n"
         "    -Z OFFSET   add OFFSET (may be nagative) to index values and SLICE positions\n"
+        "        --batch FILE     copy the range on each line of FILE (or '-', optionally preceded by '-w POS') between the same files\n"
+        "        --buffers N      number of buffers to cycle through with engine thread (default: 2)\n"
+        "        --coalesce SIZE[:MS]  write once SIZE bytes are read or MS (default: 100) ms after the first unwritten byte\n"
+        "        --delta          read output first and only write blocks that differ (needs -o or 1<>)\n"
+        "        --depth N        number of buffers in flight with engine uring (default: 8)\n"
+        "        --direct WHICH   bypass page cache for r: input, w: output or rw: both (implies -B for output)\n"
+        "        --engine ENGINE  copy using ENGINE: rw (read/write, default), zero (in-kernel, no buffer)\n"
+        "                         thread (read and write concurrently, see --buffers) or uring (asynchronous, see --depth)\n"
+        "        --expect DIGEST  fail unless the checksum (of output if both are computed) equals DIGEST\n"
+        "        --fill PATTERN   write zero, discard (release blocks) or PATTERN (with escapes like --index-delim) over +LENGTH of output\n"
+        "        --gather LIST    copy all ranges from LIST (file or '-', one 'START END' or 'START +LENGTH' per line) to output\n"
+        "        --hash ALGO      print checksum of the written data, ALGO: crc32c, xxh3 or sha256\n"
+        "        --hash-in ALGO   print checksum of the data read from input\n"
+        "        --index-delim STR     write offsets following each STR (escapes \\n, \\xHH...) to output as index, not the data\n"
+        "        --index-header W[:ADJ] write index of records headed by a W byte length, ADJ (default W) added for the size\n"
+        "        --index-size N   write index of fixed-size records of N bytes\n"
+        "        --journal FILE   record how far output is durable in FILE every 256M (see --journal-interval), to --resume from\n"
+        "        --journal-interval SIZE  write a checkpoint to the journal every SIZE bytes of output\n"
+        "        --limit RATE     copy at most RATE bytes per second\n"
+        "        --limit-file FILE  read limits ('RATE [OPS]') from FILE, again when it changes or on SIGHUP\n"
+        "        --limit-ops N    issue at most N read and write operations per second\n"
+        "        --reflink        share data blocks between input and output file where possible instead of copying\n"
+        "        --rescue MAP     keep reading past errors, zero fill unreadable sectors and record them in MAP to retry later\n"
+        "        --resume         continue from the last checkpoint in the --journal, if there is one, after verifying output\n"
+        "        --reverse        read the range (or what --rescue has left) from the end backwards\n"
+        "        --sparse         skip holes and blocks of zeros in input, leaving holes in output (punched with -w)\n"
+        "        --split TEMPLATE copy every index range to a file named by printf-style TEMPLATE (like out.%%06d)\n"
+        "        --stats-interval SEC  append a report to the stats file every SEC seconds while copying\n"
+        "        --stats-json FILE     write throughput and system call latency report as JSON to FILE\n"
+        "        --write-behind SIZE   write back each chunk right away, wait for the one SIZE behind and drop both files from cache\n"
         "\n"
         "START, END and POS are zero-based byte offsets from the start of a file.\n"
         "Subtracting END form START yields the total number of bytes to copy.\n"
@@ -248,6 +3913,7 @@ void printUsage() {
         "which are addressed using their zero-based position prefixed with ':' or '*'.\n"
         "As a shorthand, the range between two adjacent index values may be specified\n"
         "by passing the zero-based position of the range prefixed with '^' as START,\n"
+        "or any offset within the range prefixed with '@' (needs a sorted index),\n"
         "where the first range is from the beginning of the input to the first index value\n"
         "and the last range is from the last index value to the end of input.\n"
         "\n"
@@ -257,21 +3923,65 @@ void printUsage() {
 
 int main(int argc, char **argv) {
     int64_t num;
-    off64_t pos = 0, offStart = 0, offIdx = 0, offEnd = -1, offWrite = -1;
-    bool bStart = false, bLen = false, bSeekStart = true, bStatus = true, bProgLF = false, bFlushEach = true, bIgnEnd = false, bWrEmpty = false, bSync = false;
-    int opt, flagsOut = 0, bufferLen = BUFFER_DEFAULT, blockSize = 0, bufferPos, rd, wr, rq;
-    char *pathIn = NULL, *pathOut = NULL, *pathRes = NULL, *strAlign = NULL;
+    off64_t pos = 0, offStart = 0, offIdx = 0, offEnd = -1, offWrite = -1, posOut, shiftIn = 0, sizeOut = 0;
+    bool bStart = false, bLen = false, bEngine = false, bSeekStart = true, bResume = false, bBuffers = false, bStatus = true, bProgLF = false, bFlushEach = true, bIgnEnd = false, bWrEmpty = false, bSync = false, bSparse = false, bReflink = false, bAutoBuf = false, bDelta = false;
+    int64_t limitRate = 0, limitOps = 0;
+    int deltaBlock = 0, coalesce = 0, coalesceMs = COALESCE_MS;
+    int opt, nOuts = 0, flagsOut = 0, bufferLen = BUFFER_DEFAULT, blockSize = 0, align = 0, buffers = 2, depth = 8, threads = 1, sparseBlock = 0;
+    char engine = ENGINE_RW, direct = 0;
+    char *pathIn = NULL, *pathOut = NULL, *pathRes = NULL, *pathSplit = NULL, *pathGather = NULL, *pathBatch = NULL, *pathStats = NULL, *pathLimits = NULL, *strAlign = NULL;
     struct ioStatus io = {0, 0, 0, 0, -1, -1, -1, 0, STDIN_FILENO, STDOUT_FILENO, FD_IDX_DEFAULT, 0, 0};
     struct optRef optOutSeek = {0, NULL}, optOutTruncate = {0, NULL};
+    struct teeOut *outs = NULL, outDef = {.fd = -1}, *outCur = &outDef;
+    struct stat st;
+    struct autoBuffer autoBuf;
+    struct writeBehind behind = {0};
+    struct journal journal = {.interval = JOURNAL_INTERVAL};
+    struct rescue rescue = {0};
+    struct fill fill = {0};
+    struct hash hashIn = {0}, hashOut = {0};
+    struct indexGen index = {0};
+    char *expect = NULL, *sep, hex[65], sum[65];
+    void *deltaBuf = NULL;
+    FILE *list = NULL;
 
     setlocale(LC_ALL, "");
 
     // parse options
     static const struct option long_opts[] = {
         { "help", 0, 0, 'h' },
+        { "engine", 1, 0, OPT_ENGINE },
+        { "direct", 1, 0, OPT_DIRECT },
+        { "buffers", 1, 0, OPT_BUFFERS },
+        { "depth", 1, 0, OPT_DEPTH },
+        { "split", 1, 0, OPT_SPLIT },
+        { "sparse", 0, 0, OPT_SPARSE },
+        { "delta", 0, 0, OPT_DELTA },
+        { "reflink", 0, 0, OPT_REFLINK },
+        { "stats-json", 1, 0, OPT_STATS_JSON },
+        { "stats-interval", 1, 0, OPT_STATS_INTERVAL },
+        { "limit", 1, 0, OPT_LIMIT },
+        { "limit-ops", 1, 0, OPT_LIMIT_OPS },
+        { "limit-file", 1, 0, OPT_LIMIT_FILE },
+        { "write-behind", 1, 0, OPT_WRITE_BEHIND },
+        { "hash", 1, 0, OPT_HASH },
+        { "hash-in", 1, 0, OPT_HASH_IN },
+        { "expect", 1, 0, OPT_EXPECT },
+        { "index-delim", 1, 0, OPT_INDEX_DELIM },
+        { "index-size", 1, 0, OPT_INDEX_SIZE },
+        { "index-header", 1, 0, OPT_INDEX_HEADER },
+        { "gather", 1, 0, OPT_GATHER },
+        { "batch", 1, 0, OPT_BATCH },
+        { "journal", 1, 0, OPT_JOURNAL },
+        { "journal-interval", 1, 0, OPT_JOURNAL_INTERVAL },
+        { "resume", 0, 0, OPT_RESUME },
+        { "rescue", 1, 0, OPT_RESCUE },
+        { "reverse", 0, 0, OPT_REVERSE },
+        { "fill", 1, 0, OPT_FILL },
+        { "coalesce", 1, 0, OPT_COALESCE },
         { 0, 0, 0, 0 }
     };
-    while ((opt = getopt_long(argc, argv, ":a:b:BeEhi:I:no:O:pP:qQsStT:uUw:x:X:yYzZ:", long_opts, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, ":a:b:BeEhi:I:j:no:O:pP:qQsStT:uUw:x:X:yYzZ:", long_opts, NULL)) != -1) {
         if (opt == 'h') {
             if (argc > 2) {
                 msg("-h/--help cannot be combined with other options\n");
@@ -291,7 +4001,10 @@ int main(int argc, char **argv) {
             }
         } else if (opt == 'b') {
             // buffer size
-            if (parseNum(optarg, &num)) {
+            bAutoBuf = strcmp(optarg, "auto") == 0;
+            if (bAutoBuf) {
+                bufferLen = BUFFER_DEFAULT;
+            } else if (parseNum(optarg, &num)) {
                 opt = '!';
             } else {
                 bufferLen = num;
@@ -315,15 +4028,27 @@ int main(int argc, char **argv) {
         } else if (opt == 'I') {
             // input fd
             io.fdIn = atoi(optarg);
+        } else if (opt == 'j') {
+            // parallel copy
+            if (parseNum(optarg, &num)) {
+                opt = '!';
+            } else if (num < 1 || num > 1024) {
+                msg("number of threads must be between 1 and 1024\n");
+                opt = '!';
+            } else threads = num;
         } else if (opt == 'n') {
             // line-feed after progress
             bProgLF = true;
-        } else if (opt == 'o') {
-            // output file
-            pathOut = optarg;
-        } else if (opt == 'O') {
-            // output fd
-            io.fdOut = atoi(optarg);
+        } else if (opt == 'o' || opt == 'O') {
+            // output file or fd, each one given is written to
+            if (opt == 'o') pathOut = optarg; else io.fdOut = atoi(optarg);
+            if ((outs = realloc(outs, (nOuts + 1) * sizeof(*outs))) == NULL) {
+                msgerr("failed to allocate output list");
+                return EXIT_FAILURE;
+            }
+            outCur = &outs[nOuts++];
+            *outCur = outDef;
+            if (opt == 'o') outCur->path = optarg; else outCur->fd = atoi(optarg);
         } else if (opt == 'p') {
             // progress only
             bStatus = false;
@@ -347,10 +4072,12 @@ int main(int argc, char **argv) {
         } else if (opt == 't') {
             // truncate output on open
             flagsOut |= O_TRUNC;
+            outCur->flags |= O_TRUNC;
         } else if (opt == 'T') {
             // truncate output to length
             optOutTruncate.idx = optind - 1;
             optOutTruncate.str = optarg;
+            outCur->truncate = optOutTruncate;
         } else if (opt == 'u' || opt == 'U') {
             // specific endianness;
             io.endian = opt;
@@ -363,6 +4090,7 @@ int main(int argc, char **argv) {
                 optOutSeek.idx = optind - 1;
                 optOutSeek.str = optarg;
             }
+            outCur->seek = optOutSeek;
         } else if (opt == 'x') {
             // index file
             pathRes = optarg;
@@ -372,15 +4100,191 @@ int main(int argc, char **argv) {
         } else if (opt == 'y') {
             // data synchronized output
             flagsOut |= O_DSYNC;
+            outCur->flags |= O_DSYNC;
         } else if (opt == 'Y') {
             // fully synchronized output
             flagsOut |= O_SYNC;
+            outCur->flags |= O_SYNC;
         } else if (opt == 'z') {
             // don't seek in output
             optOutSeek.idx = -1;
+            outCur->seek = optOutSeek;
         } else if (opt == 'Z') {
             // index values offset
             if (parseNum(optarg, &io.offsetIn)) opt = '!';
+        } else if (opt == OPT_ENGINE) {
+            // copy engine
+            bEngine = true;
+            if (strcmp(optarg, "rw") == 0) {
+                engine = ENGINE_RW;
+            } else if (strcmp(optarg, "zero") == 0) {
+                engine = ENGINE_ZERO;
+            } else if (strcmp(optarg, "thread") == 0) {
+                engine = ENGINE_THREAD;
+            } else if (strcmp(optarg, "uring") == 0) {
+                engine = ENGINE_URING;
+            } else {
+                msg("unknown engine '%s'\n", optarg);
+                opt = '!';
+            }
+        } else if (opt == OPT_BUFFERS) {
+            // ring size for thread engine
+            if (parseNum(optarg, &num)) {
+                opt = '!';
+            } else if (num < 2) {
+                msg("number of buffers must be >1\n");
+                opt = '!';
+            } else {
+                buffers = num;
+                bBuffers = true;
+            }
+        } else if (opt == OPT_REFLINK) {
+            // clone instead of copy
+            bReflink = true;
+        } else if (opt == OPT_DELTA) {
+            // write only what differs
+            bDelta = true;
+        } else if (opt == OPT_SPARSE) {
+            // keep holes
+            bSparse = true;
+        } else if (opt == OPT_LIMIT || opt == OPT_LIMIT_OPS) {
+            // throttle bytes or operations per second
+            if (parseNum(optarg, &num)) {
+                opt = '!';
+            } else if (num < 0) {
+                msg("limit must not be negative\n");
+                opt = '!';
+            } else if (opt == OPT_LIMIT) limitRate = num; else limitOps = num;
+        } else if (opt == OPT_LIMIT_FILE) {
+            // limits adjustable while copying
+            pathLimits = optarg;
+        } else if (opt == OPT_HASH || opt == OPT_HASH_IN) {
+            // checksum of the data as written or as read
+            if ((num = hashAlg(optarg)) == 0) opt = '!';
+            else if (opt == OPT_HASH) hashOut.alg = num; else hashIn.alg = num;
+        } else if (opt == OPT_EXPECT) {
+            // digest to compare against
+            expect = optarg;
+        } else if (opt == OPT_INDEX_DELIM || opt == OPT_INDEX_SIZE || opt == OPT_INDEX_HEADER) {
+            // write an index of the input instead of copying it
+            if (index.mode) {
+                msg("only one of --index-delim, --index-size and --index-header can be used\n");
+                opt = '!';
+            } else if (opt == OPT_INDEX_DELIM) {
+                if (parseDelim(&index, optarg)) opt = '!'; else index.mode = INDEX_DELIM;
+            } else if (opt == OPT_INDEX_SIZE) {
+                if (parseNum(optarg, &num)) {
+                    opt = '!';
+                } else if (num < 1) {
+                    msg("record size must be >0\n");
+                    opt = '!';
+                } else {
+                    index.size = num;
+                    index.mode = INDEX_SIZE;
+                }
+            } else {
+                // width of the length field, optionally what to add to get the size of the record
+                if ((sep = strchr(optarg, ':')) != NULL) *sep++ = '\0';
+                if (parseNum(optarg, &num)) {
+                    opt = '!';
+                } else if (num < 1 || num > 8) {
+                    msg("length field must be 1 to 8 bytes wide\n");
+                    opt = '!';
+                } else {
+                    index.size = index.adjust = num;
+                    if (sep != NULL && parseNum(sep, &index.adjust)) opt = '!'; else index.mode = INDEX_HEADER;
+                }
+            }
+        } else if (opt == OPT_WRITE_BEHIND) {
+            // stream to disk with bounded dirty pages
+            if (parseNum(optarg, &num)) {
+                opt = '!';
+            } else if (num < 1) {
+                msg("write-behind distance must be >0\n");
+                opt = '!';
+            } else behind.dist = num;
+        } else if (opt == OPT_JOURNAL) {
+            // checkpoints to resume from
+            journal.path = optarg;
+        } else if (opt == OPT_JOURNAL_INTERVAL) {
+            // output bytes between checkpoints
+            if (parseNum(optarg, &num)) {
+                opt = '!';
+            } else if (num < 1) {
+                msg("journal interval must be >0\n");
+                opt = '!';
+            } else journal.interval = num;
+        } else if (opt == OPT_RESUME) {
+            // continue from the last checkpoint
+            bResume = true;
+        } else if (opt == OPT_RESCUE) {
+            // read around errors, map of what was read
+            rescue.path = optarg;
+        } else if (opt == OPT_REVERSE) {
+            // from the end backwards
+            rescue.bReverse = true;
+        } else if (opt == OPT_COALESCE) {
+            // bounded buffering of partial reads
+            if ((sep = strchr(optarg, ':')) != NULL) *sep++ = '\0';
+            if (parseNum(optarg, &num)) {
+                opt = '!';
+            } else if (num < 1 || num > INT_MAX) {
+                msg("coalescing size must be >0\n");
+                opt = '!';
+            } else {
+                coalesce = num;
+                if (sep != NULL && parseNum(sep, &num)) {
+                    opt = '!';
+                } else if (sep != NULL && (num < 0 || num > INT_MAX / 1000)) {
+                    msg("coalescing deadline must be between 0 and %d ms\n", INT_MAX / 1000);
+                    opt = '!';
+                } else if (sep != NULL) coalesceMs = num;
+            }
+        } else if (opt == OPT_FILL) {
+            // output filled instead of copied
+            if (strcmp(optarg, "zero") == 0) {
+                fill.mode = FILL_ZERO;
+            } else if (strcmp(optarg, "discard") == 0) {
+                fill.mode = FILL_DISCARD;
+            } else if (parseBytes(optarg, fill.pattern, &fill.len, FILL_MAX, "fill pattern")) {
+                opt = '!';
+            } else fill.mode = isZero(fill.pattern, fill.len) ? FILL_ZERO : FILL_PATTERN;
+        } else if (opt == OPT_STATS_JSON) {
+            // machine-readable report
+            pathStats = optarg;
+        } else if (opt == OPT_STATS_INTERVAL) {
+            // periodic reports, in seconds
+            if (parseNum(optarg, &num)) {
+                opt = '!';
+            } else if (num < 1) {
+                msg("stats interval must be >0\n");
+                opt = '!';
+            } else io.statsInt = num * 1000000000ULL;
+        } else if (opt == OPT_GATHER) {
+            // list of ranges into one output
+            pathGather = optarg;
+        } else if (opt == OPT_BATCH) {
+            // many copies between the same files
+            pathBatch = optarg;
+        } else if (opt == OPT_SPLIT) {
+            // all index ranges to separate files
+            pathSplit = optarg;
+        } else if (opt == OPT_DEPTH) {
+            // operations in flight for uring engine
+            if (parseNum(optarg, &num)) {
+                opt = '!';
+            } else if (num < 1 || num > 4096) {
+                msg("queue depth must be between 1 and 4096\n");
+                opt = '!';
+            } else depth = num;
+        } else if (opt == OPT_DIRECT) {
+            // bypass page cache
+            direct = 0;
+            for (char *c = optarg; *c; c++) {
+                if (*c == 'r') direct |= DIRECT_IN;
+                else if (*c == 'w') direct |= DIRECT_OUT;
+                else opt = '!';
+            }
         }
 
         if (opt == '!') {
@@ -398,12 +4302,157 @@ int main(int argc, char **argv) {
         }
     }
 
-    if (pathOut == NULL) {
+    if (threads > 1) {
+        // parallel copying is an engine of its own
+        if (bEngine) {
+            msg("-j cannot be combined with --engine\n");
+            return EXIT_FAILURE;
+        }
+        engine = ENGINE_PARALLEL;
+    }
+    if (pathSplit != NULL) {
+        if (pathOut != NULL || optOutSeek.idx > 0 || optOutTruncate.idx != 0 || argc > optind) {
+            msg("--split cannot be combined with -o, -w, -T or a range\n");
+            return EXIT_FAILURE;
+        }
+        if (bSparse || bReflink || direct) {
+            // each range goes to a fresh file opened by copySplit, which sets none of these up
+            msg("--split cannot be combined with --sparse, --reflink or --direct\n");
+            return EXIT_FAILURE;
+        }
+        if (checkTemplate(pathSplit)) return EXIT_FAILURE;
+    } else if (pathOut == NULL) {
         if (flagsOut) {
             msg("Options -t, -y and -Y can only be used in combination with -o.\n");
             return EXIT_FAILURE;
         }
-    } else flagsOut |= O_WRONLY | O_CREAT;
+    } else flagsOut |= (bDelta || bResume ? O_RDWR : O_WRONLY) | O_CREAT;
+    if (pathGather != NULL) {
+        if (argc > optind || pathSplit != NULL || index.mode || bSparse || bDelta || bReflink || hashIn.alg || hashOut.alg || behind.dist || direct) {
+            msg("--gather cannot be combined with a range, --split, --index-*, --sparse, --delta, --reflink, --hash, --write-behind or --direct\n");
+            return EXIT_FAILURE;
+        }
+        if (strcmp(pathGather, "-") == 0 && pathIn == NULL && io.fdIn == STDIN_FILENO) {
+            msg("--gather reads the list from standard input, input has to be given with -i or -I\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if (pathBatch != NULL) {
+        if (argc > optind || pathSplit != NULL || pathGather != NULL || index.mode || bSparse || bDelta || bReflink || hashIn.alg || hashOut.alg || behind.dist || direct) {
+            msg("--batch cannot be combined with a range, --split, --gather, --index-*, --sparse, --delta, --reflink, --hash, --write-behind or --direct\n");
+            return EXIT_FAILURE;
+        }
+        if (strcmp(pathBatch, "-") == 0 && pathIn == NULL && io.fdIn == STDIN_FILENO) {
+            msg("--batch reads operations from standard input, input has to be given with -i or -I\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if (journal.path != NULL && (pathSplit != NULL || pathGather != NULL || pathBatch != NULL || index.mode || bReflink)) {
+        msg("--journal cannot be combined with --split, --gather, --batch, --index-* or --reflink\n");
+        return EXIT_FAILURE;
+    }
+    if (bResume && (journal.path == NULL || flagsOut & O_TRUNC || hashIn.alg || hashOut.alg)) {
+        msg("--resume needs --journal and cannot be combined with -t, --hash or --hash-in\n");
+        return EXIT_FAILURE;
+    }
+    if (rescue.path != NULL) {
+        if (pathSplit != NULL || pathGather != NULL || pathBatch != NULL || nOuts > 1 || index.mode || bSparse || bDelta || bReflink || hashIn.alg || hashOut.alg || behind.dist || direct || journal.path != NULL) {
+            msg("--rescue cannot be combined with --split, --gather, --batch, several outputs, --index-*, --sparse, --delta, --reflink, --hash, --write-behind, --direct or --journal\n");
+            return EXIT_FAILURE;
+        }
+        if (flagsOut & O_TRUNC && access(rescue.path, F_OK) == 0) {
+            msg("rescue map exists, -t would discard what earlier passes read: %s\n", rescue.path);
+            return EXIT_FAILURE;
+        }
+    } else if (rescue.bReverse) {
+        msg("--reverse can only be used in combination with --rescue\n");
+        return EXIT_FAILURE;
+    }
+    if (fill.mode && (pathIn != NULL || io.fdIn != STDIN_FILENO || pathRes != NULL || pathSplit != NULL || pathGather != NULL || pathBatch != NULL || rescue.path != NULL || nOuts > 1 || index.mode || bSparse || bDelta || bReflink || hashIn.alg || hashOut.alg || behind.dist || direct || journal.path != NULL)) {
+        msg("--fill cannot be combined with -i, -I, -x, --split, --gather, --batch, --rescue, several outputs, --index-*, --sparse, --delta, --reflink, --hash, --write-behind, --direct or --journal\n");
+        return EXIT_FAILURE;
+    }
+    if (nOuts > 1) {
+        if (pathSplit != NULL || pathGather != NULL || pathBatch != NULL || index.mode || bSparse || bDelta || bReflink || hashIn.alg || hashOut.alg || behind.dist || direct || journal.path != NULL || coalesce) {
+            msg("several outputs cannot be combined with --split, --gather, --batch, --index-*, --sparse, --delta, --reflink, --hash, --write-behind, --direct, --journal or --coalesce\n");
+            return EXIT_FAILURE;
+        }
+        for (int k = 0; k < nOuts; k++) {
+            if (outs[k].path == NULL && outs[k].flags) {
+                msg("Options -t, -y and -Y can only be used in combination with -o.\n");
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    if (bDelta && (bSparse || pathSplit != NULL)) {
+        msg("--delta cannot be combined with --sparse or --split\n");
+        return EXIT_FAILURE;
+    }
+    if (index.mode && (pathSplit != NULL || bSparse || bDelta || bReflink || hashOut.alg)) {
+        msg("index generation cannot be combined with --split, --sparse, --delta, --reflink or --hash\n");
+        return EXIT_FAILURE;
+    }
+    if (expect != NULL && (!hashIn.alg && !hashOut.alg)) {
+        msg("--expect can only be used in combination with --hash or --hash-in\n");
+        return EXIT_FAILURE;
+    }
+    if (expect != NULL && pathSplit != NULL) {
+        msg("--expect cannot be used with --split\n");
+        return EXIT_FAILURE;
+    }
+    if (hashIn.alg || hashOut.alg) {
+        // data has to pass through the buffer in order
+        if (engine == ENGINE_ZERO || engine == ENGINE_URING || engine == ENGINE_PARALLEL) {
+            if (bStatus) msg("checksums require engine rw or thread\n");
+            engine = ENGINE_RW;
+        }
+        if (bReflink) {
+            if (bStatus) msg("cloned data cannot be checksummed, not using reflink\n");
+            bReflink = false;
+        }
+        if (hashIn.alg) hashStart(&hashIn, hashIn.alg);
+        if (hashOut.alg) hashStart(&hashOut, hashOut.alg);
+    }
+    if (coalesce && engine != ENGINE_RW) {
+        // reads are waited for one at a time
+        if (bStatus) msg("coalescing requires engine rw\n");
+        engine = ENGINE_RW;
+    }
+    if (io.statsInt && pathStats == NULL) {
+        msg("--stats-interval can only be used in combination with --stats-json\n");
+        return EXIT_FAILURE;
+    }
+
+    if (pathStats != NULL) {
+        // open stats file, system call latencies are only timed for the report
+        if ((io.stats = fopen(pathStats, "w")) == NULL) {
+            msg("failed to open stats file: %s: %s\n", pathStats, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        io.lat = calloc(LAT_KINDS, sizeof(struct latHist));
+    }
+    io.tStart = io.tRate = clockNs();
+    io.statsNext = io.tStart + io.statsInt;
+
+    if (limitRate || limitOps || pathLimits != NULL) {
+        // token bucket, the limits file overrides the options and is read again on SIGHUP
+        struct throttle *t = calloc(1, sizeof(struct throttle));
+        struct sigaction sa;
+        pthread_mutex_init(&t->lock, NULL);
+        t->rate = limitRate;
+        t->ops = limitOps;
+        t->path = pathLimits;
+        t->tFill = t->tCheck = io.tStart;
+        t->bStatus = bStatus;
+        if (pathLimits != NULL) {
+            if (readLimits(t)) return EXIT_FAILURE;
+            memset(&sa, 0, sizeof(sa));
+            sa.sa_handler = onHangup;
+            sa.sa_flags = SA_RESTART;
+            sigaction(SIGHUP, &sa, NULL);
+        } else if (bStatus) msg("limits: %'" PRId64 " bytes/s, %'" PRId64 " ops/s\n", t->rate, t->ops);
+        io.limit = t;
+    }
 
     if (pathRes != NULL) {
         // open index file
@@ -413,13 +4462,16 @@ int main(int argc, char **argv) {
         }
         if (bStatus) msg("index: %s\n", pathRes);
     }
+    mapIdx(&io);
 
     // open input
     if (pathIn != NULL && (io.fdIn = open(pathIn, O_RDONLY)) == -1) {
         msg("failed to open input file: %s: %s\n", pathIn, strerror(errno));
         return EXIT_FAILURE;
     }
-    if (bStatus) {
+    if (fill.mode) {
+        if (bStatus) msg("filling: %s\n", fill.mode == FILL_ZERO ? "zeros" : fill.mode == FILL_DISCARD ? "discard" : "pattern");
+    } else if (bStatus) {
         msg("reading: ");
         if (pathIn == NULL) {
             printFD(io.fdIn);
@@ -428,12 +4480,57 @@ int main(int argc, char **argv) {
         }
     }
 
-    // open output
+    // split by index, each range to its own file
+    if (pathSplit != NULL) {
+        if (bStatus) msg("writing: %s\n", pathSplit);
+        if (behind.dist && (engine == ENGINE_URING || engine == ENGINE_PARALLEL)) {
+            if (bStatus) msg("write-behind requires engine rw, zero or thread\n");
+            engine = ENGINE_RW;
+        }
+        if (bAutoBuf) {
+            bufferLen = autoSeed(&autoBuf, io.fdIn, -1, 0);
+            if (bStatus) msg("buffer size: %'d bytes (auto)\n", bufferLen);
+        }
+        if ((io.buffer = allocBuffer(bufferLen, 0)) == NULL) {
+            msgerr("failed to allocate buffer");
+            return EXIT_FAILURE;
+        }
+        struct copyJob job = {
+            .bufferLen = bufferLen, .blockSize = bufferLen, .buffers = buffers, .depth = depth, .threads = threads, .engine = engine,
+            .bStatus = bStatus, .bProgLF = bProgLF, .bFlushEach = bFlushEach, .bWrEmpty = bWrEmpty, .bSync = bSync, .coalesce = coalesce, .coalesceMs = coalesceMs,
+            .autoBuf = bAutoBuf ? &autoBuf : NULL, .behind = behind.dist ? &behind : NULL,
+            .hashIn = hashIn.alg ? &hashIn : NULL, .hashOut = hashOut.alg ? &hashOut : NULL
+        };
+        autoBuf.t = clockNs();
+        return copySplit(&io, &job, &offIdx, pathSplit, flagsOut, bIgnEnd);
+    }
+
+    // open output, or all of several ones
+    if (nOuts > 1) {
+        for (int k = 0; k < nOuts; k++) {
+            struct teeOut *o = &outs[k];
+            if (o->path != NULL && (o->fd = open(o->path, o->flags | O_WRONLY | O_CREAT, 0666)) == -1) {
+                msg("failed to open output file: %s: %s\n", o->path, strerror(errno));
+                return EXIT_FAILURE;
+            }
+            if (o->path != NULL) o->name = o->path; else if (asprintf(&o->name, "fd %d", o->fd) == -1) o->name = "output";
+            if (bStatus) {
+                msg("writing: ");
+                if (o->path == NULL) {
+                    printFD(o->fd);
+                } else {
+                    msg("+%s\n", o->path);
+                }
+            }
+        }
+        io.fdOut = outs[0].fd;
+        pathOut = NULL;
+    }
     if (pathOut != NULL && (io.fdOut = open(pathOut, flagsOut, 0666)) == -1) {
         msg("failed to open output file: %s: %s\n", pathOut, strerror(errno));
         return EXIT_FAILURE;
     }
-    if (bStatus) {
+    if (bStatus && nOuts < 2) {
         msg("writing: ");
         if (pathOut == NULL) {
             printFD(io.fdOut);
@@ -444,9 +4541,15 @@ int main(int argc, char **argv) {
 
     // parse range
     if (argc > optind) {
-        if (argv[optind][0] == '^') {
-            // range from index
-            if (parseNum(&argv[optind][1], &num)) return errArg(optind);
+        if (argv[optind][0] == '^' || argv[optind][0] == '@') {
+            // range from index, by position or by an offset within
+            if (argv[optind][0] == '^') {
+                if (parseNum(&argv[optind][1], &num)) return errArg(optind);
+            } else {
+                if (parseOffset(&argv[optind][1], &offStart, &io) || findIdx(&io, &offIdx, offStart, &num)) return errArg(optind);
+                if (bStatus) msg("offset %'" PRId64 " lies in range ^%" PRId64 "\n", offStart, num);
+                offStart = 0;
+            }
             // start
             if (num > 0) if (readIdx(&io, &offIdx, num - 1, &offStart)) return errArg(optind);
             // end
@@ -498,7 +4601,7 @@ int main(int argc, char **argv) {
         }
     } else bSeekStart = false;
 
-    if (pathRes != NULL) close(io.fdIdx);
+    if (pathRes != NULL && pathGather == NULL && pathBatch == NULL) close(io.fdIdx);
 
     if (argc > (optind + 1)) {
         msg("superfluous argument #%d: %s\n", optind + 1, argv[optind + 1]);
@@ -512,11 +4615,29 @@ int main(int argc, char **argv) {
     }
 
     // seek input
-    if (bSeekStart) {
+    if (bSeekStart && !fill.mode) {
         if (seek(io.fdIn, &offStart, "input")) return 1;
         pos = offStart;
     }
 
+    // several outputs, each one truncated and positioned like a single one would be and written by a thread of its own
+    if (nOuts > 1) {
+        for (int k = 0; k < nOuts; k++) {
+            if (teePrepare(&io, &outs[k], bStatus)) return EXIT_FAILURE;
+        }
+        if (engine != ENGINE_RW && bStatus) msg("several outputs are written by a thread each, engine not used\n");
+        if ((io.buffer = allocBuffer(bufferLen, 0)) == NULL) {
+            msgerr("failed to allocate buffer");
+            return EXIT_FAILURE;
+        }
+        if (offEnd >= 0) io.total = offEnd - pos;
+        struct copyJob job = {
+            .pos = pos, .offStart = offStart, .offEnd = offEnd, .bufferLen = bufferLen, .blockSize = bufferLen, .buffers = bBuffers ? buffers : TEE_BUFFERS,
+            .bStatus = bStatus, .bProgLF = bProgLF, .bFlushEach = bFlushEach, .bWrEmpty = bWrEmpty, .bSync = bSync
+        };
+        return copyTee(&io, &job, outs, nOuts, bIgnEnd);
+    }
+
     // truncate output
     if (optOutTruncate.idx != 0) {
         if (parseOffset(optOutTruncate.str, &num, &io)) return errArg(optOutTruncate.idx);
@@ -538,10 +4659,269 @@ int main(int argc, char **argv) {
         offWrite = lseek64(io.fdOut, 0, SEEK_END);
     }
 
+    // fill output, no input to read
+    if (fill.mode) {
+        if (bStart || offEnd < 0) {
+            msg("--fill needs a length as +LENGTH, not a range\n");
+            return EXIT_FAILURE;
+        }
+        if (engine != ENGINE_RW && bStatus) msg("filling writes by itself, engine not used\n");
+        struct copyJob job = {
+            .bufferLen = bufferLen, .blockSize = bufferLen,
+            .bStatus = bStatus, .bProgLF = bProgLF, .bSync = bSync
+        };
+        return copyFill(&io, &job, &fill, offEnd - offStart);
+    }
+
+    // gather ranges from a list, each read and written at its offset
+    if (pathGather != NULL) {
+        if ((list = strcmp(pathGather, "-") == 0 ? stdin : fopen(pathGather, "r")) == NULL) {
+            msg("failed to open range list: %s: %s\n", pathGather, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        if (lseek64(io.fdIn, 0, SEEK_CUR) == -1) {
+            msg("--gather needs seekable input\n");
+            return EXIT_FAILURE;
+        }
+        if (engine != ENGINE_RW && bStatus) msg("gathering reads and writes by itself, engine not used\n");
+        posOut = offWrite != -1 ? offWrite : lseek64(io.fdOut, 0, SEEK_CUR);
+        num = fcntl(io.fdOut, F_GETFL);
+        if (num == -1 || num & O_APPEND) posOut = -1;
+        if ((io.buffer = allocBuffer(bufferLen, 0)) == NULL) {
+            msgerr("failed to allocate buffer");
+            return EXIT_FAILURE;
+        }
+        struct copyJob job = {
+            .posOut = posOut, .bufferLen = bufferLen, .blockSize = bufferLen,
+            .bStatus = bStatus, .bProgLF = bProgLF, .bSync = bSync
+        };
+        return copyGather(&io, &job, list, &offIdx, bIgnEnd);
+    }
+
+    // one copy per line of a batch, files and buffer stay open in between
+    if (pathBatch != NULL) {
+        if ((list = strcmp(pathBatch, "-") == 0 ? stdin : fopen(pathBatch, "r")) == NULL) {
+            msg("failed to open batch: %s: %s\n", pathBatch, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        if (lseek64(io.fdIn, 0, SEEK_CUR) == -1) {
+            msg("--batch needs seekable input\n");
+            return EXIT_FAILURE;
+        }
+        if (engine == ENGINE_URING || engine == ENGINE_PARALLEL) {
+            if (bStatus) msg("batch requires engine rw, zero or thread\n");
+            engine = ENGINE_RW;
+        }
+        if (engine == ENGINE_ZERO && !bFlushEach) {
+            if (bStatus) msg("forced buffering (-B) cannot be used with engine zero\n");
+            engine = ENGINE_RW;
+        }
+        posOut = offWrite != -1 ? offWrite : lseek64(io.fdOut, 0, SEEK_CUR);
+        num = fcntl(io.fdOut, F_GETFL);
+        if (num == -1 || num & O_APPEND) posOut = -1;
+        if (bAutoBuf) {
+            bufferLen = autoSeed(&autoBuf, io.fdIn, io.fdOut, 0);
+            if (bStatus) msg("buffer size: %'d bytes (auto)\n", bufferLen);
+        }
+        if ((io.buffer = allocBuffer(bufferLen, 0)) == NULL) {
+            msgerr("failed to allocate buffer");
+            return EXIT_FAILURE;
+        }
+        struct copyJob job = {
+            .posOut = posOut, .bufferLen = bufferLen, .blockSize = bufferLen, .buffers = buffers, .depth = depth, .threads = threads, .engine = engine,
+            .bStatus = bStatus, .bProgLF = bProgLF, .bFlushEach = bFlushEach, .bWrEmpty = bWrEmpty, .bSync = bSync, .coalesce = coalesce, .coalesceMs = coalesceMs,
+            .autoBuf = bAutoBuf ? &autoBuf : NULL
+        };
+        autoBuf.t = clockNs();
+        return copyBatch(&io, &job, list, &offIdx, bIgnEnd);
+    }
+
+    // rescue, reading what earlier passes could not, around errors
+    if (rescue.path != NULL) {
+        rescue.start = offStart;
+        rescue.end = offEnd;
+        rescue.inBase = lseek64(io.fdIn, 0, SEEK_CUR) - pos;
+        rescue.outBase = offWrite != -1 ? offWrite : lseek64(io.fdOut, 0, SEEK_CUR);
+        rescue.bOutSet = optOutSeek.idx > 0;
+        num = fcntl(io.fdOut, F_GETFL);
+        if (rescue.inBase < 0 || rescue.outBase == -1 || num == -1 || num & O_APPEND) {
+            msg("--rescue needs seekable input and output\n");
+            return EXIT_FAILURE;
+        }
+        if (rescue.end < 0) {
+            if (seekEnd(io.fdIn, &io.lenIn, "input")) return EXIT_FAILURE;
+            rescue.end = io.lenIn - rescue.inBase;
+        }
+        if (rescue.end < rescue.start) rescue.end = rescue.start;
+        // smallest read to retry with, a sector of block devices
+        rescue.sector = blockAlign(io.fdIn);
+        if (rescue.sector < 512 || rescue.sector > bufferLen) rescue.sector = bufferLen < 512 ? bufferLen : 512;
+        rescue.tmp = malloc(strlen(rescue.path) + 5);
+        sprintf(rescue.tmp, "%s.tmp", rescue.path);
+        rescue.tSave = clockNs() + RESCUE_SAVE;
+        if (engine != ENGINE_RW && engine != ENGINE_PARALLEL && bStatus) msg("rescue reads and writes by itself, engine not used\n");
+        io.total = 0;
+        struct copyJob job = {
+            .bufferLen = bufferLen, .blockSize = bufferLen, .threads = threads,
+            .bStatus = bStatus, .bProgLF = bProgLF
+        };
+        return copyRescue(&io, &job, &rescue, bIgnEnd);
+    }
+
+    // engine constraints
+    if (engine == ENGINE_ZERO && !bFlushEach) {
+        if (bStatus) msg("forced buffering (-B) cannot be used with engine zero\n");
+        engine = ENGINE_RW;
+    }
+
+    // checkpoints, continuing after the last one of an earlier run
+    if (journal.path != NULL) {
+        off64_t in = lseek64(io.fdIn, 0, SEEK_CUR);
+        journal.start = offStart;
+        journal.end = offEnd;
+        num = offWrite != -1 ? offWrite : lseek64(io.fdOut, 0, SEEK_CUR);
+        if (num == -1 || in == -1) {
+            msg("--journal needs seekable input and output\n");
+            return EXIT_FAILURE;
+        }
+        if (in != pos) {
+            // positions are recorded and checked as offsets of the input
+            msg("--journal needs START when the input is not at offset 0\n");
+            return EXIT_FAILURE;
+        }
+        if (engine == ENGINE_URING || engine == ENGINE_PARALLEL) {
+            if (bStatus) msg("journal requires engine rw, zero or thread\n");
+            engine = ENGINE_RW;
+        }
+        journal.check = malloc(JOURNAL_CHECK);
+        journal.tmp = malloc(strlen(journal.path) + 5);
+        sprintf(journal.tmp, "%s.tmp", journal.path);
+        if (bResume) {
+            int len, found = journalLoad(&journal, &offStart, &num, &len, hex);
+            if (found == 1) return EXIT_FAILURE;
+            if (found == 0) {
+                // the output before the checkpoint has to be what was copied there
+                if (journalSum(&journal, io.fdOut, num, len, sum)) {
+                    if (errno != EBADF) {
+                        msg("failed to read output before offset %'" PRId64 " to verify it: %s\n", num, strerror(errno));
+                        return EXIT_FAILURE;
+                    }
+                    if (bStatus) msg("output cannot be read, last checkpoint not verified\n");
+                } else if (strcmp(hex, sum) != 0) {
+                    msg("output before offset %'" PRId64 " does not match the journal, not resuming\n", num);
+                    return EXIT_FAILURE;
+                }
+                if (seek(io.fdIn, &offStart, "input") || seek(io.fdOut, &num, "output")) return EXIT_FAILURE;
+                pos = offStart;
+                bSeekStart = true;
+                if (bStatus) msg("resuming at offset %'" PRId64 " of input, %'" PRId64 " of output\n", offStart, num);
+            } else if (bStatus) msg("no journal to resume from, starting at the beginning\n");
+        }
+        journal.inFrom = offStart;
+        offWrite = journal.outFrom = num;
+        journal.next = num + journal.interval;
+        if (bStatus) msg("journal: %s, checkpoint every %'" PRId64 " bytes\n", journal.path, journal.interval);
+    }
+
+    // sparse output
+    posOut = offWrite;
+    if (bSparse) {
+        if (posOut == -1) posOut = lseek64(io.fdOut, 0, SEEK_CUR);
+        num = fcntl(io.fdOut, F_GETFL);
+        if (posOut == -1 || num == -1 || num & O_APPEND || fstat(io.fdOut, &st) == -1 || !S_ISREG(st.st_mode)) {
+            if (bStatus) msg("sparse copy needs a seekable regular output file, not opened for appending\n");
+            bSparse = false;
+        } else {
+            sizeOut = st.st_size;
+            sparseBlock = st.st_blksize > 0 ? st.st_blksize : 4096;
+        }
+        if (bSparse && engine != ENGINE_RW && engine != ENGINE_THREAD) {
+            if (bStatus) msg("sparse copy requires engine rw or thread\n");
+            engine = ENGINE_RW;
+        }
+    }
+
+    // compare before write
+    if (bDelta) {
+        if (posOut == -1) posOut = lseek64(io.fdOut, 0, SEEK_CUR);
+        num = fcntl(io.fdOut, F_GETFL);
+        if (posOut == -1 || num == -1 || (num & O_ACCMODE) != O_RDWR || num & O_APPEND || fstat(io.fdOut, &st) == -1) {
+            if (bStatus) msg("delta copy needs a seekable output opened for reading and writing, not for appending\n");
+            bDelta = false;
+        } else {
+            deltaBlock = st.st_blksize > 0 ? st.st_blksize : 4096;
+            if (engine != ENGINE_RW && engine != ENGINE_THREAD) {
+                if (bStatus) msg("delta copy requires engine rw or thread\n");
+                engine = ENGINE_RW;
+            }
+        }
+    }
+
+    // write an index instead of the data
+    if (index.mode) {
+        if (engine != ENGINE_RW && engine != ENGINE_THREAD) {
+            if (bStatus) msg("index generation requires engine rw or thread\n");
+            engine = ENGINE_RW;
+        }
+        indexStart(&index, offStart);
+    }
+
+    // write-behind
+    if (behind.dist) {
+        if (posOut == -1) posOut = lseek64(io.fdOut, 0, SEEK_CUR);
+        if (posOut == -1 || fstat(io.fdOut, &st) == -1 || !S_ISREG(st.st_mode)) {
+            if (bStatus) msg("write-behind needs a seekable regular output file\n");
+            behind.dist = 0;
+        } else if (engine == ENGINE_URING || engine == ENGINE_PARALLEL) {
+            if (bStatus) msg("write-behind requires engine rw, zero or thread\n");
+            engine = ENGINE_RW;
+        }
+    }
+
+    // direct I/O
+    if (direct) {
+        if (direct & DIRECT_IN) {
+            num = lseek64(io.fdIn, 0, SEEK_CUR);
+            if (num == -1 || setDirect(io.fdIn, true)) {
+                msg("direct I/O not possible on input: %s\n", strerror(errno));
+                direct &= ~DIRECT_IN;
+            } else {
+                shiftIn = num - pos;
+                align = blockAlign(io.fdIn);
+            }
+        }
+        if (direct & DIRECT_OUT) {
+            if (posOut == -1) posOut = lseek64(io.fdOut, 0, SEEK_CUR);
+            if (posOut == -1 || setDirect(io.fdOut, true)) {
+                msg("direct I/O not possible on output: %s\n", strerror(errno));
+                direct &= ~DIRECT_OUT;
+            } else {
+                num = blockAlign(io.fdOut);
+                if (num > align) align = num;
+                // only write whole blocks
+                bFlushEach = false;
+            }
+        }
+        if (align < 1) align = 512;
+        if (direct == (DIRECT_IN | DIRECT_OUT) && (offStart + shiftIn - posOut) % align != 0) {
+            if (bStatus) msg("input and output are not equally aligned, using direct I/O for output only\n");
+            setDirect(io.fdIn, false);
+            direct = DIRECT_OUT;
+        }
+        if (direct) {
+            bufferLen = (bufferLen + align - 1) / align * align;
+            if (strAlign == NULL) strAlign = direct & DIRECT_OUT ? "w" : "r";
+            if (bStatus) msg("direct I/O: %s%s%s, %d byte blocks\n", direct & DIRECT_IN ? "input" : "", direct == (DIRECT_IN | DIRECT_OUT) ? ", " : "", direct & DIRECT_OUT ? "output" : "", align);
+        }
+    }
+
+    // buffer size from preferred I/O sizes
+    if (bAutoBuf) bufferLen = autoSeed(&autoBuf, io.fdIn, io.fdOut, direct ? align : 0);
+
     // buffer allignment
     if (strAlign != NULL) {
-        if (strAlign[0] == 'r') blockSize = -offStart;
-        else if (strAlign[0] == 'w' && offWrite != -1) blockSize = -offWrite;
+        if (strAlign[0] == 'r') blockSize = -(offStart + shiftIn);
+        else if (strAlign[0] == 'w' && posOut != -1) blockSize = -posOut;
         blockSize = ((blockSize % bufferLen) + bufferLen) % bufferLen;
     }
     if (blockSize == 0) blockSize = bufferLen;
@@ -557,7 +4937,7 @@ int main(int argc, char **argv) {
     }
     if (offEnd >= 0) {
         io.total = offEnd - pos;
-        if (io.total < bufferLen) {
+        if (io.total < bufferLen && !direct) {
             bufferLen = (io.total < 1 ? 1 : io.total);
             if (blockSize > bufferLen) blockSize = bufferLen;
         }
@@ -571,66 +4951,75 @@ int main(int argc, char **argv) {
         msg("+ at ");
         if (blockSize != bufferLen) msg("+%d + ", blockSize);
         msg("+%'d bytes", bufferLen);
-        if (io.total != -1) msg("+ * %" PRId64, ((io.total - (blockSize < bufferLen ? blockSize : 0)) + bufferLen - 1) / bufferLen);
+        if (bAutoBuf) msg("+ (auto)");
+        else if (io.total != -1) msg("+ * %" PRId64, ((io.total - (blockSize < bufferLen ? blockSize : 0)) + bufferLen - 1) / bufferLen);
         msg("+\n");
     }
-    io.buffer = malloc(bufferLen);
+    if ((io.buffer = allocBuffer(bufferLen, direct ? align : 0)) == NULL || (bDelta && (deltaBuf = allocBuffer(bufferLen, direct ? align : 0)) == NULL)) {
+        msgerr("failed to allocate buffer");
+        return EXIT_FAILURE;
+    }
 
     // copy
-    bufferPos = 0;
+    struct copyJob job = {
+        .pos = pos, .offStart = offStart, .offEnd = offEnd, .posOut = posOut,
+        .bufferLen = bufferLen, .blockSize = blockSize, .align = align, .shiftIn = shiftIn,
+        .buffers = buffers, .depth = depth, .threads = threads, .engine = engine, .direct = direct, .directSet = direct,
+        .bStatus = bStatus, .bProgLF = bProgLF, .bFlushEach = bFlushEach, .bWrEmpty = bWrEmpty, .bSync = bSync, .coalesce = coalesce, .coalesceMs = coalesceMs,
+        .bSparse = bSparse, .bReflink = bReflink, .sizeOut = sizeOut, .sparseBlock = sparseBlock,
+        .deltaBlock = deltaBlock, .deltaBuf = deltaBuf, .autoBuf = bAutoBuf ? &autoBuf : NULL, .behind = behind.dist ? &behind : NULL, .journal = journal.path != NULL ? &journal : NULL,
+        .hashIn = hashIn.alg ? &hashIn : NULL, .hashOut = hashOut.alg ? &hashOut : NULL, .index = index.mode ? &index : NULL
+    };
+    autoBuf.anchor = pos + blockSize;
+    autoBuf.t = clockNs();
     if (io.prog > 1) printStats(&io, bProgLF ? '\n' : ' ');
-    do {
-        rq = (offEnd >= 0 && (pos + bufferLen) > offEnd ? offEnd - pos : blockSize) - bufferPos;
-        rd = read(io.fdIn, io.buffer + bufferPos, rq);
-        io.rd++;
-        if (rd < 0) break;
-        io.in += rd;
-        bufferPos += rd;
-        if (bFlushEach || rd == 0 || rd == rq) {
-            num = pos;
-            pos += bufferPos;
-            if (pos >= offStart) {
-                num = offStart > num ? offStart - num : 0;
-                rq = bufferPos - num;
-                if (rq > 0 || bWrEmpty) {
-                    wr = write(io.fdOut, io.buffer + num, rq);
-                    if (bSync && wr != -1 && fsync(io.fdOut) == -1) msgerr("sync failed");
-                    io.wr++;
-                } else wr = 0;
-                if (wr < 0 || wr != rq) break;
-                io.out += wr;
-            } else wr = rq = 0;
-            bufferPos = 0;
-            blockSize = bufferLen;
-        }
-        // progress
-        if (io.prog >= 0) {
-            if (!bProgLF) fprintf(stderr, "\r");
-            printStats(&io, bProgLF ? '\n' : ' ');
-        }
-    } while (rd && (offEnd < 0 || pos < offEnd));
+    if (job.behind != NULL) behindStart(&io, &job);
+    copyRange(&io, &job);
+    if (job.index != NULL && !copyFailed(&job) && indexEnd(&io, &job)) job.wr = -1;
+    if (job.behind != NULL) behindFlush(&io, &job, true);
+    if (job.journal != NULL) journalFlush(&io, &job, true);
 
     // final stats
-    if (io.prog > 0 && !bProgLF) fprintf(stderr, "\n");
-    if (bStatus && io.prog < 0) printStats(&io, '\n');
+    endStats(&io, &job);
+    if (job.journal != NULL && bStatus) msg("journal: %d checkpoints, last at offset %'" PRId64 " of output\n", journal.count, job.posOut);
 
     // error handling
-    if (rd < 0) {
-        msgerr("error reading input");
-        return EXIT_FAILURE;
-    } else if (wr < 0) {
-        msgerr("error writing output");
-        return EXIT_FAILURE;
-    } else if (wr != rq) {
-        msg("no more space to write output (%d<%d)\n", wr, rq);
-        return EXIT_FAILURE;
-    }
+    if (copyError(&job)) return EXIT_FAILURE;
 
     if (pathIn != NULL) close(io.fdIn);
     if (pathOut != NULL) close(io.fdOut);
     
-    if (offEnd >= 0 && !bIgnEnd && io.out != (offEnd - offStart)) {
-        msg("premature end of input (%'" PRIu64 " < %'" PRId64 " bytes)\n", io.out, offEnd - offStart);
+    if (offEnd >= 0 && io.out != (offEnd - offStart)) {
+        if (!bIgnEnd) {
+            msg("premature end of input (%'" PRIu64 " < %'" PRId64 " bytes)\n", io.out, offEnd - offStart);
+            return EXIT_FAILURE;
+        }
+        if (bStatus) msg("input ended at offset %'" PRId64 "\n", offStart + io.out);
+    }
+
+    // index, a length-prefixed record may have been cut off
+    if (index.mode) {
+        if (bStatus) msg("index: %'" PRIu64 " entries\n", index.count);
+        if (index.mode == INDEX_HEADER && (index.pending > index.pos || index.carryLen > 0)) {
+            if (!bIgnEnd) {
+                msg("last record is incomplete, input ended at offset %'" PRId64 "\n", index.pos);
+                return EXIT_FAILURE;
+            }
+            if (bStatus) msg("last record is incomplete, input ended at offset %'" PRId64 "\n", index.pos);
+        }
+    }
+
+    // checksums, the expected digest is compared with the output one if there is one
+    if (hashIn.alg) {
+        hashDigest(&hashIn, hex);
+        if (bStatus) msg("input %s: %s\n", hashNames[(int)hashIn.alg], hex);
+    }
+    if (hashOut.alg) {
+        hashDigest(&hashOut, hex);
+        if (bStatus) msg("output %s: %s\n", hashNames[(int)hashOut.alg], hex);
+    }
+    if (expect != NULL && strcasecmp(hex, expect) != 0) {
+        msg("checksum mismatch: %s, expected %s\n", hex, expect);
         return EXIT_FAILURE;
     }
 